@@ -24,6 +24,7 @@
 
 #include <iosfwd>
 #include <limits>
+#include <utility>
 #include <vector>
 
 enum class PadMode { DontPad, PadEven };
@@ -31,13 +32,23 @@ enum class PadMode { DontPad, PadEven };
 template <typename Format, PadMode Pad, typename... Args>
 class BasicDecoder {
 public:
-    static bool encode(std::istream& Src, std::ostream& Dst, Args... args);
+    // Any options after the format's own arguments (such as the effort level
+    // or workspace of the LZSS formats) are passed along to the format's
+    // encoder.
+    template <typename... Options>
+    static bool encode(
+            std::istream& Src, std::ostream& Dst, Args... args,
+            Options&&... options);
     static void extract(std::istream& Src, std::iostream& Dst);
+    // Same as above, but reads into a buffer in memory.
+    static void extract(std::istream& Src, std::vector<uint8_t>& Dst);
 };
 
 template <typename Format, PadMode Pad, typename... Args>
+template <typename... Options>
 bool BasicDecoder<Format, Pad, Args...>::encode(
-        std::istream& Src, std::ostream& Dst, Args... args) {
+        std::istream& Src, std::ostream& Dst, Args... args,
+        Options&&... options) {
     size_t Start = Src.tellg();
     Src.ignore(std::numeric_limits<std::streamsize>::max());
     size_t FullSize = Src.gcount();
@@ -53,7 +64,8 @@ bool BasicDecoder<Format, Pad, Args...>::encode(
         data.back() = 0;
     }
     if (Format::encode(
-                Dst, data.data(), data.size(), std::forward<Args>(args)...)) {
+                Dst, data.data(), data.size(), std::forward<Args>(args)...,
+                std::forward<Options>(options)...)) {
         // Pad to even size.
         if ((Dst.tellp() % 2) != 0) {
             Dst.put(0);
@@ -74,4 +86,16 @@ void BasicDecoder<Format, Pad, Args...>::extract(
     Dst.seekg(0);
 }
 
+template <typename Format, PadMode Pad, typename... Args>
+void BasicDecoder<Format, Pad, Args...>::extract(
+        std::istream& Src, std::vector<uint8_t>& Dst) {
+    size_t Start = Src.tellg();
+    Src.ignore(std::numeric_limits<std::streamsize>::max());
+    size_t FullSize = Src.gcount();
+    Src.seekg(Start);
+    // Pad to even size.
+    Dst.assign(FullSize + (FullSize % 2), 0);
+    Src.read(reinterpret_cast<char*>(Dst.data()), FullSize);
+}
+
 #endif    // LIB_MODULED_ADAPTOR_H
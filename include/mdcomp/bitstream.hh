@@ -20,9 +20,12 @@
 
 #include <mdcomp/bigendian_io.hh>
 
+#include <algorithm>
 #include <climits>
+#include <cstdint>
 #include <iosfwd>
 #include <limits>
+#include <type_traits>
 
 namespace detail {
 #if !defined(__clang__)
@@ -177,6 +180,123 @@ class ibitstream {
     }
 };
 
+// This class allows reading bits from a buffer in memory, in the same order as
+// ibitstream reads them from a stream. Rather than one T at a time, it keeps
+// up to 64 bits in an accumulator, which is refilled with as many whole T's as
+// fit; reading past the end of the buffer gives zeroes. Up to MaxPeekBits bits
+// can be looked at with peek() before being consumed. "EarlyRead" only changes
+// when good() fails, to match ibitstream.
+template <
+        typename T, bool EarlyRead, bool LittleEndianBits = false,
+        typename Endian = BigEndian>
+class ibitbuffer {
+public:
+    constexpr static size_t const WordBits = sizeof(T) * CHAR_BIT;
+    constexpr static size_t const MaxPeekBits
+            = std::numeric_limits<uint64_t>::digits - WordBits + 1;
+
+private:
+    constexpr static size_t const AccumBits
+            = std::numeric_limits<uint64_t>::digits;
+    // Whole 64-bit loads give the bits in the right order only if there is
+    // no byte or bit order to fix within each T.
+    constexpr static bool const CanLoadWide
+            = !LittleEndianBits
+              && (sizeof(T) == 1 || std::is_same<Endian, BigEndian>::value);
+
+    uint8_t const* data;
+    size_t         size;
+    // Bytes already moved into the accumulator.
+    size_t pos{0};
+    // Bits already consumed.
+    size_t consumed{0};
+    // The next bits to read, starting at the highest bit.
+    uint64_t bitbuffer{0};
+    size_t   avail{0};
+
+    T read_word() noexcept {
+        T word = 0;
+        if (pos + sizeof(T) <= size) {
+            uint8_t const* ptr = data + pos;
+            word = Endian::template ReadN<sizeof(T)>(ptr);
+        }
+        pos += sizeof(T);
+        return LittleEndianBits ? detail::reverseBits(word) : word;
+    }
+    void refill() noexcept {
+        if (CanLoadWide && pos + sizeof(uint64_t) <= size) {
+            uint8_t const* ptr     = data + pos;
+            uint64_t const chunk   = BigEndian::Read8(ptr);
+            size_t const   count   = (AccumBits - avail) / WordBits;
+            size_t const   newbits = count * WordBits;
+            // Keeps the highest newbits bits of the chunk; newbits is
+            // between 1 and 64, so no shift is by 64 bits.
+            uint64_t const mask = ~((~uint64_t(0) >> 1U) >> (newbits - 1));
+            bitbuffer |= (chunk & mask) >> avail;
+            avail += newbits;
+            pos += count * sizeof(T);
+            return;
+        }
+        while (avail <= AccumBits - WordBits) {
+            bitbuffer |= uint64_t(read_word())
+                         << (AccumBits - WordBits - avail);
+            avail += WordBits;
+        }
+    }
+    // How many T's ibitstream would have read by now.
+    size_t words_read() const noexcept {
+        if (EarlyRead) {
+            return consumed / WordBits + 1;
+        }
+        return std::max((consumed + WordBits - 1) / WordBits, size_t(1));
+    }
+
+public:
+    ibitbuffer(uint8_t const* src, size_t const len) noexcept
+            : data(src), size(len) {}
+    // Looks at the next cnt bits, without consuming them.
+    uint64_t peek(size_t const cnt) noexcept {
+        if (avail < cnt) {
+            refill();
+        }
+        return cnt == 0 ? 0 : bitbuffer >> (AccumBits - cnt);
+    }
+    // Consumes cnt bits, which must have been looked at with peek.
+    void consume(size_t const cnt) noexcept {
+        bitbuffer = cnt == 0 ? bitbuffer : bitbuffer << cnt;
+        avail -= cnt;
+        consumed += cnt;
+    }
+    // Gets a single bit from the buffer.
+    T pop() noexcept {
+        return read(1);
+    }
+    // Reads up to sizeof(T) * CHAR_BIT bits from the buffer.
+    T read(uint8_t const cnt) noexcept {
+        T const bits = T(peek(cnt));
+        consume(cnt);
+        return bits;
+    }
+    size_t have_waiting_bits() const noexcept {
+        size_t const used = consumed % WordBits;
+        if (!EarlyRead && used == 0 && consumed != 0) {
+            return 0;
+        }
+        return WordBits - used;
+    }
+    // How many bytes of the buffer hold bits that have been read. Unlike the
+    // position of an ibitstream, this does not count a T that was fetched
+    // early but not used, so it is where any data after the bits starts.
+    size_t tell() const noexcept {
+        size_t const words = (consumed + WordBits - 1) / WordBits;
+        return std::min(words * sizeof(T), size);
+    }
+    // False if ibitstream would have read past the end of the buffer.
+    bool good() const noexcept {
+        return words_read() * sizeof(T) <= size;
+    }
+};
+
 // This class allows outputting bits into a stream.
 template <
         typename T, bool LittleEndianBits = false, typename Endian = BigEndian>
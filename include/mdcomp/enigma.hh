@@ -25,6 +25,16 @@
 
 #include <iosfwd>
 
+// How the Enigma encoder splits the words into packets. The greedy parse
+// matches the original compressor; the optimal parse gives the smallest
+// file for the header that was picked.
+enum class EnigmaParse { greedy, optimal };
+
+// How the Enigma encoder picks the incrementing and common values and the
+// tile format for the header. The extended search tries several of them,
+// which can give a smaller file.
+enum class EnigmaSearch { standard, extended };
+
 class enigma;
 using basic_enigma   = BasicDecoder<enigma, PadMode::DontPad>;
 using moduled_enigma = ModuledAdaptor<enigma, 4096U, 1U>;
@@ -32,10 +42,18 @@ using moduled_enigma = ModuledAdaptor<enigma, 4096U, 1U>;
 class enigma : public basic_enigma, public moduled_enigma {
     friend basic_enigma;
     friend moduled_enigma;
-    static bool encode(std::ostream& Dst, uint8_t const* data, size_t Size);
+    static bool encode(
+            std::ostream& Dst, uint8_t const* data, size_t Size,
+            EnigmaParse  parse  = EnigmaParse::greedy,
+            EnigmaSearch search = EnigmaSearch::standard);
+    static size_t decode(
+            uint8_t const* data, size_t Size, std::vector<uint8_t>& Dst);
 
 public:
-    static bool encode(std::istream& Src, std::ostream& Dst);
+    static bool encode(
+            std::istream& Src, std::ostream& Dst,
+            EnigmaParse  parse  = EnigmaParse::greedy,
+            EnigmaSearch search = EnigmaSearch::standard);
     static bool decode(std::istream& Src, std::ostream& Dst);
 };
 
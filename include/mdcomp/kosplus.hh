@@ -20,6 +20,7 @@
 #define LIB_KOSPLUS_HH
 
 #include <mdcomp/basic_decoder.hh>
+#include <mdcomp/lzss.hh>
 #include <mdcomp/moduled_adaptor.hh>
 
 #include <iosfwd>
@@ -31,7 +32,20 @@ using moduled_kosplus = ModuledAdaptor<kosplus, 4096U, 1U>;
 class kosplus : public basic_kosplus, public moduled_kosplus {
     friend basic_kosplus;
     friend moduled_kosplus;
-    static bool encode(std::ostream& Dst, uint8_t const* data, size_t Size);
+    static bool encode(
+            std::ostream& Dst, uint8_t const* data, size_t Size,
+            LZSSEffort     effort      = LZSSEffort::optimal,
+            size_t         numthreads  = hardware_thread_count(),
+            MatchFinder    matchfinder = MatchFinder::hash_chain,
+            LZSSWorkspace& workspace   = LZSSWorkspace::thread_default());
+    // Each module is encoded on a single thread, as the modules themselves
+    // are encoded at the same time.
+    static bool encode_module(
+            std::ostream& Dst, uint8_t const* data, size_t Size,
+            size_t PadMaskBits, LZSSEffort effort = LZSSEffort::optimal,
+            MatchFinder matchfinder = MatchFinder::hash_chain);
+    static size_t decode(
+            uint8_t const* data, size_t Size, std::vector<uint8_t>& Dst);
 
 public:
     using basic_kosplus::encode;
@@ -23,13 +23,19 @@
 
 #include <mdcomp/bigendian_io.hh>
 #include <mdcomp/bitstream.hh>
+#include <mdcomp/parallel.hh>
+#include <mdcomp/suffix_array.hh>
 
 #include <algorithm>
 #include <array>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <iosfwd>
 #include <limits>
-#include <list>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #ifdef _MSC_VER
@@ -38,8 +44,117 @@
     __assume(false);
 }
 #    endif
+#    include <intrin.h>
 #endif
 
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#endif
+
+namespace detail {
+    // Position of the lowest (or highest, on big-endian machines) set bit of
+    // a nonzero value; this is the position of the first byte that differs
+    // in a word loaded from memory.
+    inline size_t first_set_byte(uint64_t const val) noexcept {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return size_t(__builtin_clzll(val)) / 8U;
+#elif defined(__GNUG__)
+        return size_t(__builtin_ctzll(val)) / 8U;
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward64(&index, val);
+        return index / 8U;
+#else
+        size_t index = 0;
+        while ((val & (uint64_t(0xFFU) << (8U * index))) == 0) {
+            index++;
+        }
+        return index;
+#endif
+    }
+
+    // Lowest set bit of a nonzero SIMD comparison mask.
+    inline size_t first_set_bit(uint32_t const val) noexcept {
+#if defined(__GNUG__)
+        return size_t(__builtin_ctz(val));
+#elif defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, val);
+        return index;
+#else
+        size_t index = 0;
+        while ((val & (uint32_t(1U) << index)) == 0) {
+            index++;
+        }
+        return index;
+#endif
+    }
+
+    // Counts how many of the first limit bytes of two buffers are equal. This
+    // compares as many bytes at a time as the machine allows, and only falls
+    // back to bytes for the tail.
+    inline size_t common_prefix_length(
+            uint8_t const* lhs, uint8_t const* rhs,
+            size_t const limit) noexcept {
+        size_t len = 0;
+#if defined(__AVX2__)
+        for (; len + sizeof(__m256i) <= limit; len += sizeof(__m256i)) {
+            __m256i left;
+            __m256i right;
+            std::memcpy(&left, lhs + len, sizeof(__m256i));
+            std::memcpy(&right, rhs + len, sizeof(__m256i));
+            uint32_t const mask = ~static_cast<uint32_t>(
+                    _mm256_movemask_epi8(_mm256_cmpeq_epi8(left, right)));
+            if (mask != 0) {
+                return len + first_set_bit(mask);
+            }
+        }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+        for (; len + sizeof(__m128i) <= limit; len += sizeof(__m128i)) {
+            __m128i left;
+            __m128i right;
+            std::memcpy(&left, lhs + len, sizeof(__m128i));
+            std::memcpy(&right, rhs + len, sizeof(__m128i));
+            uint32_t const mask = ~static_cast<uint32_t>(
+                    _mm_movemask_epi8(_mm_cmpeq_epi8(left, right)));
+            if ((mask & 0xFFFFU) != 0) {
+                return len + first_set_bit(mask);
+            }
+        }
+#endif
+        for (; len + sizeof(uint64_t) <= limit; len += sizeof(uint64_t)) {
+            uint64_t left;
+            uint64_t right;
+            std::memcpy(&left, lhs + len, sizeof(uint64_t));
+            std::memcpy(&right, rhs + len, sizeof(uint64_t));
+            uint64_t const diff = left ^ right;
+            if (diff != 0) {
+                return len + first_set_byte(diff);
+            }
+        }
+        while (len < limit && lhs[len] == rhs[len]) {
+            len++;
+        }
+        return len;
+    }
+}    // namespace detail
+
+// Counts how many characters at the start of two strings are equal, up to a
+// maximum of limit characters.
+template <typename stream_t>
+inline size_t match_length(
+        stream_t const* lhs, stream_t const* rhs, size_t const limit) noexcept {
+    // Characters are equal if, and only if, all of their bytes are equal.
+    return detail::common_prefix_length(
+                   reinterpret_cast<uint8_t const*>(lhs),
+                   reinterpret_cast<uint8_t const*>(rhs),
+                   limit * sizeof(stream_t))
+           / sizeof(stream_t);
+}
+
 /*
  * Class representing an edge in the LZSS-compression graph. An edge (u, v)
  * indicates that there is a sliding window match that covers all the characters
@@ -103,20 +218,273 @@ class AdjListNode {
     }
 };
 
+/*
+ * Strategies the sliding window can use to find the longest (and, among those,
+ * the closest) dictionary match for the current position. All of them give the
+ * exact same matches; they differ only on how fast they find them.
+ */
+enum class MatchFinder {
+    // Compares the look-ahead buffer against every position in the search
+    // buffer.
+    brute_force,
+    // Only compares the look-ahead buffer against positions in the search
+    // buffer that start with the same minmatchlen characters; these are kept
+    // in hash chains, from closest to farthest.
+    hash_chain,
+    // Builds the suffix and LCP arrays of the whole file once, and shares them
+    // among all sliding windows; each search then takes logarithmic time, no
+    // matter what the data looks like. Building them and searching on a
+    // single thread makes this slower on most data, but it is much faster on
+    // data that makes the hash chains long, such as a few distinct values
+    // mixed over a large file.
+    suffix_array
+};
+
+/*
+ * How hard the LZSS encoders try to find a small parse. All levels produce
+ * streams that the decoders accept; the lower levels are faster, but give
+ * larger files.
+ */
+enum class LZSSEffort {
+    // Always takes the longest match at each position.
+    greedy,
+    // Like greedy, but covers a position with a literal instead if there is a
+    // longer match at the next position.
+    lazy,
+    // Finds the optimal parse among the matches found by a bounded search,
+    // which looks at a limited number of candidates for each position, and
+    // stops at the first match that is long enough.
+    bounded,
+    // Finds the optimal parse among all possible matches.
+    optimal
+};
+
+// Limits on the search for dictionary matches at each position. They only
+// apply to the hash chain and brute force match finders; the suffix array
+// always finds the longest match, so with it the effort only changes how the
+// parse is done.
+struct MatchSearchLimits {
+    // How many hash chain candidates to look at, at most. The brute force
+    // search ignores this: its candidates are just the closest positions, and
+    // looking only at a few of them would miss nearly all matches.
+    size_t max_candidates;
+    // Finding a match at least this long ends the search.
+    size_t nice_length;
+};
+
+constexpr MatchSearchLimits get_search_limits(
+        LZSSEffort const effort) noexcept {
+    switch (effort) {
+    case LZSSEffort::greedy:
+        return {8, 16};
+    case LZSSEffort::lazy:
+        return {32, 32};
+    case LZSSEffort::bounded:
+        return {128, 128};
+    case LZSSEffort::optimal:
+        return {std::numeric_limits<size_t>::max(),
+                std::numeric_limits<size_t>::max()};
+    }
+    __builtin_unreachable();
+}
+
+/*
+ * Hash chains of all positions in the data, keyed by the first minmatchlen
+ * characters at each position. Walking a chain gives the candidates from
+ * closest to farthest. The chains are built up front and never change, so
+ * they can be walked from several threads at once.
+ */
+template <typename Adaptor>
+class HashChain {
+public:
+    using stream_t = typename Adaptor::stream_t;
+
+    constexpr static size_t const npos = std::numeric_limits<size_t>::max();
+
+    HashChain(
+            stream_t const* dt, size_t const size,
+            size_t const minmatch) noexcept
+            : data(dt), nlen(size), minmatchlen(minmatch),
+              hashbits(get_hash_bits(size)), prev(size, npos) {
+        // Most recent position for each hash value.
+        std::vector<size_t> head(size_t(1) << hashbits, npos);
+        // Positions without enough characters left for a full match are
+        // left out.
+        for (size_t pos = 0; pos + minmatchlen <= nlen; pos++) {
+            size_t& first = head[hash(pos)];
+            prev[pos]     = first;
+            first         = pos;
+        }
+    }
+
+    // Gets the closest position before pos with the same hash as pos. The
+    // caller must make sure that there are at least minmatchlen characters at
+    // pos.
+    size_t first_candidate(size_t const pos) const noexcept {
+        return prev[pos];
+    }
+
+    // Gets the next farther position with the same hash as pos.
+    size_t next_candidate(size_t const pos) const noexcept {
+        return prev[pos];
+    }
+
+private:
+    static size_t get_hash_bits(size_t const size) noexcept {
+        // Enough buckets for all positions, but at most 2^16 of them.
+        size_t bits = 8;
+        while (bits < 16 && (size_t(1) << bits) < size) {
+            bits++;
+        }
+        return bits;
+    }
+
+    size_t hash(size_t const pos) const noexcept {
+        // Multiplicative hashing of the first minmatchlen characters.
+        uint64_t value = 0;
+        for (size_t ii = 0; ii < minmatchlen; ii++) {
+            value = (value ^ data[pos + ii]) * 0x9E3779B97F4A7C15ULL;
+        }
+        return value >> (64U - hashbits);
+    }
+
+    stream_t const* const data;
+    size_t const          nlen;
+    size_t const          minmatchlen;
+    size_t const          hashbits;
+    // Previous position with the same hash value, for each position.
+    std::vector<size_t> prev;
+};
+
+template <typename Adaptor>
+constexpr size_t const HashChain<Adaptor>::npos;
+
+/*
+ * Finds the dictionary match candidates for a position once, on behalf of all
+ * of the sliding windows of an adaptor, instead of having each window scan the
+ * same data on its own. Candidates are listed from closest to farthest, and
+ * each one is strictly longer than the one before it; this is all a window
+ * needs to pick its own longest (and, among those, closest) match, whatever
+ * its search buffer size and maximum match length are.
+ */
+template <typename Adaptor>
+class MatchCandidates {
+public:
+    using stream_t = typename Adaptor::stream_t;
+    struct Candidate {
+        // Where the match starts.
+        size_t pos;
+        // How long the match is.
+        size_t length;
+    };
+    using CandidateVector = std::vector<Candidate>;
+
+    MatchCandidates(
+            stream_t const* dt, size_t const size, size_t const minmatch,
+            MatchFinder const how = Adaptor::MatchFinderType,
+            MatchSearchLimits const lim = get_search_limits(
+                    LZSSEffort::optimal)) noexcept
+            : data(dt), minmatchlen(minmatch), matchfinder(how), limits(lim),
+              chain(make_chain(dt, size, minmatch, how)) {}
+
+    // Finds the candidates for basenode that start in the [lbound, basenode)
+    // range, with lengths capped at end characters. This does not change the
+    // object, and can be called for any position from several threads.
+    void find(
+            size_t const basenode, size_t const lbound, size_t const end,
+            CandidateVector& candidates) const noexcept {
+        // This is what we produce.
+        candidates.clear();
+        if (matchfinder == MatchFinder::hash_chain) {
+            // Any match shorter than this would be discarded anyway.
+            if (end < minmatchlen) {
+                return;
+            }
+            // Only positions sharing the first minmatchlen characters can
+            // give a match we can use; and they come in the same order as in
+            // the brute force search, so the same matches win.
+            add_candidates(
+                    chain.first_candidate(basenode),
+                    [this](size_t const ii) noexcept {
+                        return chain.next_candidate(ii);
+                    },
+                    basenode, lbound, end, candidates);
+        } else if (basenode > lbound) {
+            add_candidates(
+                    basenode - 1,
+                    [](size_t const ii) noexcept {
+                        return ii == 0 ? npos : ii - 1;
+                    },
+                    basenode, lbound, end, candidates);
+        }
+    }
+
+private:
+    constexpr static size_t const npos = HashChain<Adaptor>::npos;
+
+    static HashChain<Adaptor> make_chain(
+            stream_t const* dt, size_t const size, size_t const minmatch,
+            MatchFinder const how) noexcept {
+        // The other match finders need no chains, so don't waste memory on
+        // them.
+        return how == MatchFinder::hash_chain
+                       ? HashChain<Adaptor>(dt, size, minmatch)
+                       : HashChain<Adaptor>(dt, 0, minmatch);
+    }
+
+    template <typename Next>
+    void add_candidates(
+            size_t ii, Next&& next, size_t const basenode, size_t const lbound,
+            size_t const end, CandidateVector& candidates) const noexcept {
+        size_t best_len = 0;
+        size_t left     = matchfinder == MatchFinder::hash_chain
+                                  ? limits.max_candidates
+                                  : npos;
+        for (; ii != npos && ii >= lbound && left != 0; ii = next(ii), left--) {
+            // A position can only give a longer match than the best one so
+            // far if it also matches the character right after it.
+            if (best_len != 0
+                && data[ii + best_len] != data[basenode + best_len]) {
+                continue;
+            }
+            size_t const jj
+                    = match_length(data + ii, data + basenode, end);
+            if (best_len < jj) {
+                best_len = jj;
+                candidates.push_back({ii, jj});
+                if (jj == end || jj >= limits.nice_length) {
+                    break;
+                }
+            }
+        }
+    }
+
+    stream_t const* const   data;
+    size_t const            minmatchlen;
+    MatchFinder const       matchfinder;
+    MatchSearchLimits const limits;
+    // Index of previous positions, for the hash chain match finder.
+    HashChain<Adaptor> chain;
+};
+
+template <typename Adaptor>
+constexpr size_t const MatchCandidates<Adaptor>::npos;
+
 template <typename Adaptor>
 class SlidingWindow {
 public:
-    using EdgeType    = typename Adaptor::EdgeType;
-    using stream_t    = typename Adaptor::stream_t;
-    using Node_t      = AdjListNode<Adaptor>;
-    using MatchVector = std::vector<Node_t>;
+    using EdgeType        = typename Adaptor::EdgeType;
+    using stream_t        = typename Adaptor::stream_t;
+    using Node_t          = AdjListNode<Adaptor>;
+    using MatchVector     = std::vector<Node_t>;
+    using CandidateVector = typename MatchCandidates<Adaptor>::CandidateVector;
 
     SlidingWindow(
             stream_t const* dt, size_t const size, size_t const bufsize,
             size_t const minmatch, size_t const labuflen,
             EdgeType const ty) noexcept
-            : data(dt), nlen(size), srchbufsize(bufsize), minmatchlen(minmatch),
-              basenode(Adaptor::FirstMatchPosition),
+            : data(dt), nlen(size), srchbufsize(bufsize), labufsize(labuflen),
+              minmatchlen(minmatch), basenode(Adaptor::FirstMatchPosition),
               ubound(std::min(labuflen + basenode, nlen)),
               lbound(basenode > srchbufsize ? basenode - srchbufsize : 0),
               type(ty) {}
@@ -125,6 +493,10 @@ class SlidingWindow {
         return nlen;
     }
 
+    size_t getMinMatchLength() const {
+        return minmatchlen;
+    }
+
     size_t getSearchBufSize() const {
         return basenode - lbound;
     }
@@ -150,7 +522,90 @@ class SlidingWindow {
         return getLookAheadBufSize() != 0;
     }
 
-    void find_matches(MatchVector& matches) const noexcept {
+    // Moves the window so that it looks for matches at the given position,
+    // as if it had been slid there from the start.
+    void slideTo(size_t const pos) noexcept {
+        basenode = pos;
+        ubound   = std::min(labufsize + basenode, nlen);
+        lbound   = basenode > srchbufsize ? basenode - srchbufsize : 0;
+    }
+
+    // Finds the longest (and, among those, closest) dictionary match at the
+    // current position. All prefixes of this match that are at least
+    // getMinMatchLength() characters long are also valid matches.
+    void find_matches(MatchVector& matches) noexcept {
+        find_matches_with(
+                matches, [this](
+                                 size_t const end, size_t& best_pos,
+                                 size_t& best_len) noexcept {
+                    size_t ii = basenode - 1;
+                    do {
+                        // Keep looking for dictionary matches.
+                        size_t const jj
+                                = match_length(data + ii, data + basenode, end);
+                        if (best_len < jj) {
+                            best_pos = ii;
+                            best_len = jj;
+                        }
+                        if (jj == end) {
+                            break;
+                        }
+                    } while (ii-- > lbound);
+                });
+    }
+
+    // Same as above, but picks the match from the candidates found for the
+    // current position by a search shared by all of the sliding windows.
+    void find_matches(
+            MatchVector& matches, CandidateVector const& candidates) noexcept {
+        find_matches_with(
+                matches, [this, &candidates](
+                                 size_t const end, size_t& best_pos,
+                                 size_t& best_len) noexcept {
+                    // Candidates get longer the farther back they are, so the
+                    // farthest one in the search buffer wins -- unless one
+                    // before it is already as long as this window allows.
+                    for (auto const& candidate : candidates) {
+                        if (candidate.pos < lbound) {
+                            break;
+                        }
+                        best_pos = candidate.pos;
+                        best_len = std::min(candidate.length, end);
+                        if (best_len == end) {
+                            break;
+                        }
+                    }
+                });
+    }
+
+    // Same as above, but uses an index of the whole file shared by all of the
+    // sliding windows.
+    void find_matches(
+            MatchVector& matches, SuffixArray<stream_t>& index) noexcept {
+        find_matches_with(
+                matches, [this, &index](
+                                 size_t const end, size_t& best_pos,
+                                 size_t& best_len) noexcept {
+                    index.find_longest_match(
+                            basenode, lbound, end, best_pos, best_len);
+                });
+    }
+
+    bool find_extra_matches(MatchVector& matches) const noexcept {
+        static_assert(
+                noexcept(Adaptor::extra_matches(
+                        data, basenode, ubound, lbound,
+                        std::declval<MatchVector&>())),
+                "Adaptor::extra_matches() is not noexcept");
+        // This is what we produce.
+        matches.clear();
+        // Get extra dictionary matches dependent on specific encoder.
+        return Adaptor::extra_matches(data, basenode, ubound, lbound, matches);
+    }
+
+private:
+    template <typename Finder>
+    void find_matches_with(MatchVector& matches, Finder&& finder) noexcept {
         static_assert(
                 noexcept(Adaptor::edge_weight(EdgeType(), size_t())),
                 "Adaptor::edge_weight() is not noexcept");
@@ -161,53 +616,23 @@ class SlidingWindow {
         if (getSearchBufSize() == 0) {
             return;
         }
-        size_t ii       = basenode - 1;
         size_t best_pos = 0;
         size_t best_len = 0;
-        do {
-            // Keep looking for dictionary matches.
-            size_t jj = 0;
-            while (jj < end && data[ii + jj] == data[basenode + jj]) {
-                ++jj;
-            }
-            if (best_len < jj) {
-                best_pos = ii;
-                best_len = jj;
-            }
-            if (jj == end) {
-                break;
-            }
-        } while (ii-- > lbound);
+        finder(end, best_pos, best_len);
 
         if (best_len >= minmatchlen) {
             // We have found a match that links (basenode) with
             // (basenode + best_len) with length (best_len) and distance
-            // equal to (basenode-best_pos).
-            // Add it, and all prefixes, to the list, as long as it is a better
-            // match.
-            for (size_t jj = minmatchlen; jj <= best_len; ++jj) {
-                matches.emplace_back(basenode, basenode - best_pos, jj, type);
-            }
+            // equal to (basenode-best_pos). Its prefixes are left implicit.
+            matches.emplace_back(basenode, basenode - best_pos, best_len, type);
         }
     }
 
-    bool find_extra_matches(MatchVector& matches) const noexcept {
-        static_assert(
-                noexcept(Adaptor::extra_matches(
-                        data, basenode, ubound, lbound,
-                        std::declval<MatchVector&>())),
-                "Adaptor::extra_matches() is not noexcept");
-        // This is what we produce.
-        matches.clear();
-        // Get extra dictionary matches dependent on specific encoder.
-        return Adaptor::extra_matches(data, basenode, ubound, lbound, matches);
-    }
-
-private:
     // Source file data and its size; one node per character in source file.
     stream_t const* const data;
     size_t const          nlen;
     size_t const          srchbufsize;
+    size_t const          labufsize;
     size_t const          minmatchlen;
     size_t                basenode;
     size_t                ubound;
@@ -215,6 +640,149 @@ class SlidingWindow {
     EdgeType const        type;
 };
 
+/*
+ * State of a node while finding the optimal parse: the lowest cost to reach it
+ * from the start of the file, and the edge that does so. The parent of the
+ * node is not stored, as it is just the node the edge starts at; literal
+ * symbols are not stored either, as they can be read from the data. This
+ * keeps the whole state of a node in 12 bytes, at the cost of limiting the
+ * total cost of the parse to 32 bits -- that is, to files of a few hundred
+ * megabytes at most. Larger files get the lazy parse instead.
+ */
+template <typename Adaptor>
+class ParseNode {
+public:
+    using EdgeType = typename Adaptor::EdgeType;
+    using Node_t   = AdjListNode<Adaptor>;
+
+    constexpr static size_t const NoCost = std::numeric_limits<uint32_t>::max();
+    constexpr static uint32_t const NoDistance
+            = std::numeric_limits<uint32_t>::max();
+
+    static_assert(
+            Adaptor::NumDescBits <= std::numeric_limits<uint8_t>::max(),
+            "Descriptor bitfield is too large for ParseNode");
+    static_assert(
+            Adaptor::LookAheadBufSize <= std::numeric_limits<uint16_t>::max(),
+            "Look-ahead buffer is too large for ParseNode");
+    static_assert(
+            Adaptor::SearchBufSize < NoDistance,
+            "Search buffer is too large for ParseNode");
+
+    // How many nodes a parse can have and still be sure that the costs fit.
+    // Literals alone give an upper bound for the cost of each node; half of
+    // the range is left for the edge out of it and for the end of the file.
+    constexpr static size_t max_nodes() noexcept {
+        return NoCost / 2 / Adaptor::edge_weight(EdgeType::symbolwise, 1);
+    }
+    // Total cost, in bits, to reach the node.
+    constexpr size_t get_cost() const noexcept {
+        return cost;
+    }
+    // Descriptor bits used along the way, modulo the size of the descriptor
+    // bitfield.
+    constexpr size_t get_desc() const noexcept {
+        return desc;
+    }
+    // The node that the best edge to this node starts at.
+    constexpr size_t get_parent(size_t const node) const noexcept {
+        return node - length;
+    }
+    // Rebuilds the best edge to this node.
+    template <typename stream_t>
+    constexpr Node_t get_edge(
+            size_t const node, stream_t const symbol) const noexcept {
+        size_t const pos = get_parent(node) + Adaptor::FirstMatchPosition;
+        auto const   ty  = static_cast<EdgeType>(type);
+        if (ty == EdgeType::symbolwise) {
+            return Node_t(pos, symbol, ty);
+        }
+        size_t const dist = distance == NoDistance
+                                    ? std::numeric_limits<size_t>::max()
+                                    : distance;
+        return Node_t(pos, dist, length, ty);
+    }
+
+    void start() noexcept {
+        cost = 0;
+        desc = 0;
+    }
+    void update(
+            size_t const wgt, size_t const desccost, EdgeType const ty,
+            size_t const len, size_t const dist) noexcept {
+        cost     = static_cast<uint32_t>(wgt);
+        distance = dist >= NoDistance ? NoDistance
+                                      : static_cast<uint32_t>(dist);
+        length   = static_cast<uint16_t>(len);
+        type     = static_cast<uint8_t>(ty);
+        desc     = static_cast<uint8_t>(desccost % Adaptor::NumDescBits);
+    }
+
+private:
+    uint32_t cost{static_cast<uint32_t>(NoCost)};
+    uint32_t distance{0};
+    uint16_t length{0};
+    uint8_t  type{0};
+    uint8_t  desc{0};
+};
+
+/*
+ * Buffers used by the LZSS encoders, kept from one call to the next so that
+ * encoding many small files is not dominated by allocating and freeing
+ * memory. The buffers only ever grow. A workspace can be passed to any of the
+ * LZSS encoders, and each of them gets its own set of buffers from it; but it
+ * must not be used by several threads at once. Each thread has a default
+ * workspace, which is used when no other is given.
+ */
+class LZSSWorkspace {
+public:
+    LZSSWorkspace() noexcept                = default;
+    LZSSWorkspace(LZSSWorkspace const&)     = delete;
+    LZSSWorkspace(LZSSWorkspace&&) noexcept = default;
+    LZSSWorkspace& operator=(LZSSWorkspace const&) = delete;
+    LZSSWorkspace& operator=(LZSSWorkspace&&) noexcept = default;
+    ~LZSSWorkspace() noexcept                          = default;
+
+    static LZSSWorkspace& thread_default() noexcept {
+        thread_local LZSSWorkspace workspace;
+        return workspace;
+    }
+
+    // Gets the buffers of the given type, creating them on first use.
+    template <typename Buffers>
+    Buffers& get() noexcept {
+        // Each type of buffer is identified by the address of its own tag.
+        static char const tag = 0;
+        for (auto const& slot : slots) {
+            if (slot.first == &tag) {
+                return *static_cast<Buffers*>(slot.second.get());
+            }
+        }
+        slots.emplace_back(&tag, std::make_shared<Buffers>());
+        return *static_cast<Buffers*>(slots.back().second.get());
+    }
+
+private:
+    std::vector<std::pair<void const*, std::shared_ptr<void>>> slots;
+};
+
+// Buffers used by find_optimal_lzss_parse.
+template <typename Adaptor>
+struct LZSSParseBuffers {
+    using Node_t          = AdjListNode<Adaptor>;
+    using CandidateVector = typename MatchCandidates<Adaptor>::CandidateVector;
+
+    // The state of all nodes in the graph.
+    std::vector<ParseNode<Adaptor>> nodes;
+    // The longest match of each window for each node in a batch.
+    std::vector<Node_t> found;
+    // Matches and candidates for a single node.
+    std::vector<Node_t> matches;
+    CandidateVector     candidates;
+    // The parse that is returned.
+    std::vector<Node_t> parse;
+};
+
 /*
  * Function which creates a LZSS structure and finds the optimal parse.
  *
@@ -243,6 +811,9 @@ class SlidingWindow {
  *    constexpr static bool const DescriptorLittleEndianBits = true;
  *    // How many characters to skip looking for matchs for at the start.
  *    constexpr static size_t const FirstMatchPosition = 0;
+ *    // How the sliding windows look for dictionary matches by default.
+ *    constexpr static MatchFinder const MatchFinderType
+ *            = MatchFinder::hash_chain;
  *    // Size of the search buffer.
  *    constexpr static size_t const SearchBufSize = 8192;
  *    // Size of the look-ahead buffer.
@@ -262,19 +833,38 @@ class SlidingWindow {
  *                      size_t const ubound, size_t const lbound,
  *                      std::vector<AdjListNode<Adaptor>> &matches) noexcept;
  *    // Function that computes padding between modules, if any. May be
- *    //constexpr.
- *    static size_t get_padding(size_t const totallen) noexcept;
+ *    // constexpr or static; it is called on the adaptor object that is
+ *    // passed in, so it can depend on how the module will be padded.
+ *    size_t get_padding(size_t const totallen) const noexcept;
+ *
+ * The parse is returned as a vector with the edges in order; the optimal parse
+ * sizes it exactly, so it takes a single allocation.
+ *
+ * The matches for each node can be searched using up to numthreads threads;
+ * the result is the same no matter how many are used.
+ *
+ * The matches are found with the given match finder, which defaults to the
+ * one the adaptor asks for. With the optimal effort, all of them give the
+ * same parse, so the choice only changes the speed.
+ *
+ * All buffers, including the returned parse, belong to the given workspace;
+ * the parse is only valid until the workspace is used again.
+ *
+ * The costs of the optimal parse must fit in 32 bits (see ParseNode); files
+ * too large for that get the lazy parse, whatever the effort.
  */
 template <typename Adaptor>
-auto find_optimal_lzss_parse(
-        uint8_t const* dt, size_t const size, Adaptor adaptor) noexcept {
-    ignore_unused_variable_warning(adaptor);
+auto const& find_optimal_lzss_parse(
+        uint8_t const* dt, size_t const size, Adaptor adaptor,
+        LZSSWorkspace& workspace, LZSSEffort const effort = LZSSEffort::optimal,
+        size_t const      numthreads  = 1,
+        MatchFinder const matchfinder = Adaptor::MatchFinderType) noexcept {
     using EdgeType        = typename Adaptor::EdgeType;
     using stream_t        = typename Adaptor::stream_t;
     using stream_endian_t = typename Adaptor::stream_endian_t;
     using Node_t          = AdjListNode<Adaptor>;
-    using AdjList         = std::list<Node_t>;
     using MatchVector     = std::vector<Node_t>;
+    using CandidateVector = typename MatchCandidates<Adaptor>::CandidateVector;
 
     auto read_stream = [](uint8_t const*& ptr) {
         return stream_endian_t::template ReadN<sizeof(stream_t)>(ptr);
@@ -287,42 +877,135 @@ auto find_optimal_lzss_parse(
             noexcept(Adaptor::desc_bits(EdgeType())),
             "Adaptor::desc_bits() is not noexcept");
     static_assert(
-            noexcept(Adaptor::get_padding(0)),
+            noexcept(adaptor.get_padding(0)),
             "Adaptor::get_padding() is not noexcept");
     auto assume = [](bool result) {
         if (!result) {
             __builtin_unreachable();
         }
     };
-    assume(nlen >= Adaptor::FirstMatchPosition);
-    size_t numNodes = nlen - Adaptor::FirstMatchPosition;
+    size_t numNodes = nlen > Adaptor::FirstMatchPosition
+                              ? nlen - Adaptor::FirstMatchPosition
+                              : 0;
     assume(nlen < std::numeric_limits<size_t>::max() - 1);
-    // Auxiliary data structures:
-    // * The parent of a node is the node that reaches that node with the
-    //   lowest cost from the start of the file.
-    std::vector<size_t> parents(numNodes + 1);
-    // * This is the edge used to go from the parent of a node to said node.
-    std::vector<Node_t> pedges(numNodes + 1);
-    // * This is the total cost to reach the edge. They start as high as
-    //   possible for all nodes but the first, which starts at 0.
-    std::vector<size_t> costs(numNodes + 1, std::numeric_limits<size_t>::max());
-    costs[0] = 0;
-    // * And this is a vector that tallies up the amount of bits in
-    //   the descriptor bitfield for the shortest path up to this node.
-    //   After tallying up the ending node, the end-of-file marker may cause
-    //   an additional dummy descriptor bitfield to be emitted; this vector
-    //   is used to counteract that.
-    std::vector<size_t> desccosts(
-            numNodes + 1, std::numeric_limits<size_t>::max());
-    desccosts[0] = 0;
+
+    auto         winSet     = Adaptor::create_sliding_window(data, nlen);
+    size_t const numWindows = winSet.size();
+    // Index of the whole file shared by all sliding windows, if they use it.
+    SuffixArray<stream_t> index(
+            data, matchfinder == MatchFinder::suffix_array ? nlen : 0);
+    // Otherwise, the sliding windows share a single search for candidates,
+    // which covers the largest of them.
+    size_t minmatchlen = std::numeric_limits<size_t>::max();
+    for (auto const& win : winSet) {
+        minmatchlen = std::min(minmatchlen, win.getMinMatchLength());
+    }
+    MatchCandidates<Adaptor> const finder(
+            data, nlen, minmatchlen, matchfinder, get_search_limits(effort));
+    auto&            buffers    = workspace.get<LZSSParseBuffers<Adaptor>>();
+    CandidateVector& candidates = buffers.candidates;
+    MatchVector&     matches    = buffers.matches;
+    // This is what we will produce.
+    MatchVector& parselist = buffers.parse;
+    parselist.clear();
+    if (numNodes == 0) {
+        // Nothing to parse.
+        return parselist;
+    }
+
+    // Builds the symbolwise edge for a node.
+    auto get_literal = [&](size_t const ii) noexcept {
+        size_t const basenode = ii + Adaptor::FirstMatchPosition;
+        const auto*  ptr = reinterpret_cast<const uint8_t*>(data + basenode);
+        const stream_t val = read_stream(ptr);
+        return Node_t(basenode, val, EdgeType::symbolwise);
+    };
+
+    // The lazy parse does not need the costs, so it is the fallback for files
+    // that are too large for them.
+    LZSSEffort const parse = numNodes > ParseNode<Adaptor>::max_nodes()
+                                     ? std::min(effort, LZSSEffort::lazy)
+                                     : effort;
+    if (parse == LZSSEffort::greedy || parse == LZSSEffort::lazy) {
+        // Finds the edge that covers the most characters from a node; among
+        // those, the one that costs the least.
+        auto find_longest_edge = [&](size_t const ii) noexcept {
+            size_t const basenode = ii + Adaptor::FirstMatchPosition;
+            Node_t       best     = get_literal(ii);
+            for (auto& win : winSet) {
+                win.slideTo(basenode);
+            }
+            if (matchfinder != MatchFinder::suffix_array) {
+                size_t srchbufsize = 0;
+                size_t labuflen    = 0;
+                for (auto const& win : winSet) {
+                    srchbufsize = std::max(srchbufsize, win.getSearchBufSize());
+                    labuflen = std::max(labuflen, win.getLookAheadBufSize());
+                }
+                finder.find(
+                        basenode, basenode - srchbufsize, labuflen,
+                        candidates);
+            }
+            for (auto& win : winSet) {
+                if (!win.find_extra_matches(matches)) {
+                    if (matchfinder == MatchFinder::suffix_array) {
+                        win.find_matches(matches, index);
+                    } else {
+                        win.find_matches(matches, candidates);
+                    }
+                }
+                for (const auto& elem : matches) {
+                    if (elem.get_type() == EdgeType::invalid) {
+                        continue;
+                    }
+                    if (elem.get_length() > best.get_length()
+                        || (elem.get_length() == best.get_length()
+                            && elem.get_weight() < best.get_weight())) {
+                        best = elem;
+                    }
+                }
+            }
+            return best;
+        };
+
+        size_t ii   = 0;
+        Node_t edge = find_longest_edge(0);
+        while (ii < numNodes) {
+            if (parse == LZSSEffort::lazy && edge.get_length() > 1
+                && ii + 1 < numNodes) {
+                // If the next node has a longer match, it is better to
+                // cover this node with a literal and take that match instead.
+                Node_t next = find_longest_edge(ii + 1);
+                if (next.get_length() > edge.get_length()) {
+                    parselist.push_back(get_literal(ii));
+                    ii++;
+                    edge = next;
+                    continue;
+                }
+            }
+            parselist.push_back(edge);
+            ii += edge.get_length();
+            if (ii < numNodes) {
+                edge = find_longest_edge(ii);
+            }
+        }
+        return parselist;
+    }
+
+    // The state of all nodes in the graph, in a single array so that relaxing
+    // an edge only touches the target node. All nodes start with a cost as
+    // high as possible but the first, which starts at 0.
+    auto& nodes = buffers.nodes;
+    nodes.assign(numNodes + 1, ParseNode<Adaptor>());
+    nodes[0].start();
 
     // Extracting distance relax logic from the loop so it can be used more
     // often.
-    auto Relax = [nlen, &costs, &desccosts, &parents,
-                  &pedges](size_t ii, size_t const basedesc, const auto& elem) {
+    auto Relax = [nlen, &nodes, &adaptor](
+                         size_t ii, size_t const basedesc, const auto& elem) {
         // Need destination ID and edge weight.
         size_t const nextnode = elem.get_dest() - Adaptor::FirstMatchPosition;
-        size_t       wgt      = costs[ii] + elem.get_weight();
+        size_t       wgt      = nodes[ii].get_cost() + elem.get_weight();
         // Compute descriptor bits from using this edge.
         size_t desccost = basedesc + Adaptor::desc_bits(elem.get_type());
         if (nextnode == nlen) {
@@ -341,58 +1024,145 @@ auto find_optimal_lzss_parse(
                 desccost += (Adaptor::NumDescBits - descmod);
             }
             // Compensate for the Adaptor's padding, if any.
-            wgt += Adaptor::get_padding(wgt);
+            wgt += adaptor.get_padding(wgt);
         }
         // Is the cost to reach the target node through this edge less
         // than the current cost?
-        if (costs[nextnode] > wgt) {
-            // If so, update the data structures with new best edge.
-            costs[nextnode]     = wgt;
-            parents[nextnode]   = ii;
-            pedges[nextnode]    = elem;
-            desccosts[nextnode] = desccost;
+        if (nodes[nextnode].get_cost() > wgt) {
+            // If so, update the target node with new best edge.
+            nodes[nextnode].update(
+                    wgt, desccost, elem.get_type(), elem.get_length(),
+                    elem.get_distance());
+        }
+    };
+
+    // Relaxes a dictionary match and all of its prefixes that are at least
+    // minlen characters long, in order of increasing length. This is the same
+    // as calling Relax for each of them, but there is no need to build all of
+    // the edges beforehand: a prefix only becomes an edge if it is the best
+    // way to reach its target node.
+    auto RelaxPrefixes = [nlen, &nodes, &Relax](
+                                 size_t ii, size_t const basedesc,
+                                 const auto& elem, size_t const minlen) {
+        EdgeType const type     = elem.get_type();
+        size_t const   basecost = nodes[ii].get_cost();
+        size_t const   desccost = basedesc + Adaptor::desc_bits(type);
+        size_t const   dist     = elem.get_distance();
+        size_t         maxlen   = elem.get_length();
+        // The end-of-file marker only matters for the edge to the last node,
+        // so that one is left for Relax.
+        bool const reaches_end = ii + maxlen == nlen;
+        if (reaches_end) {
+            maxlen--;
+        }
+        for (size_t len = minlen; len <= maxlen; len++) {
+            size_t const nextnode = ii + len;
+            size_t const wgt      = basecost + Adaptor::edge_weight(type, len);
+            if (nodes[nextnode].get_cost() > wgt) {
+                nodes[nextnode].update(wgt, desccost, type, len, dist);
+            }
+        }
+        if (reaches_end) {
+            Relax(ii, basedesc, elem);
+        }
+    };
+
+    // Finding the matches for a node does not depend on the shortest paths,
+    // so they are found ahead of time for a batch of nodes, with the work
+    // split among several threads. The suffix array must see the nodes in
+    // order, so it gets a single thread.
+    constexpr size_t const BatchSize = 65536;
+    constexpr size_t const BlockSize = 4096;
+    size_t const           numWorkers
+            = matchfinder == MatchFinder::suffix_array
+                      ? 1
+                      : std::max(numthreads, size_t(1));
+    // * The longest match of each window for each node in the batch, if any.
+    auto& found = buffers.found;
+    found.resize(std::min(BatchSize, numNodes) * numWindows);
+    size_t batchstart = 0;
+    auto find_block = [&](size_t const first, size_t const last) noexcept {
+        // Each block gets its own copy of the sliding windows and buffers.
+        auto            windows = winSet;
+        CandidateVector blockcandidates;
+        blockcandidates.reserve(Adaptor::LookAheadBufSize);
+        MatchVector blockmatches;
+        for (auto& win : windows) {
+            win.slideTo(batchstart + first + Adaptor::FirstMatchPosition);
+        }
+        for (size_t jj = first; jj < last; jj++) {
+            if (matchfinder != MatchFinder::suffix_array) {
+                size_t const basenode
+                        = batchstart + jj + Adaptor::FirstMatchPosition;
+                size_t srchbufsize = 0;
+                size_t labuflen    = 0;
+                for (auto const& win : windows) {
+                    srchbufsize = std::max(srchbufsize, win.getSearchBufSize());
+                    labuflen = std::max(labuflen, win.getLookAheadBufSize());
+                }
+                finder.find(
+                        basenode, basenode - srchbufsize, labuflen,
+                        blockcandidates);
+            }
+            Node_t* out = &found[jj * numWindows];
+            for (auto& win : windows) {
+                if (matchfinder == MatchFinder::suffix_array) {
+                    win.find_matches(blockmatches, index);
+                } else {
+                    win.find_matches(blockmatches, blockcandidates);
+                }
+                *out++ = blockmatches.empty() ? Node_t()
+                                              : blockmatches.front();
+                win.slideWindow();
+            }
         }
     };
 
     // Since the LZSS graph is a topologically-sorted DAG by construction,
     // computing the shortest distance is very quick and easy: just go
     // through the nodes in order and update the distances.
-    auto        winSet = Adaptor::create_sliding_window(data, nlen);
-    MatchVector matches;
-    matches.reserve(Adaptor::LookAheadBufSize);
-    for (size_t ii = 0; ii < numNodes; ii++) {
-        // Get remaining unused descriptor bits up to this node.
-        size_t const basedesc = desccosts[ii];
-        // Start with the literal/symbolwise encoding of the current node.
-        {
-            const auto* ptr = reinterpret_cast<const uint8_t*>(
-                    data + ii + Adaptor::FirstMatchPosition);
-            const stream_t val = read_stream(ptr);
-            Relax(ii, basedesc,
-                  Node_t(ii + Adaptor::FirstMatchPosition, val,
-                         EdgeType::symbolwise));
-        }
-        // Get the adjacency list for this node.
-        for (auto& win : winSet) {
-            if (!win.find_extra_matches(matches)) {
-                win.find_matches(matches);
-            }
-            for (const auto& elem : matches) {
-                if (elem.get_type() != EdgeType::invalid) {
-                    Relax(ii, basedesc, elem);
+    for (; batchstart < numNodes; batchstart += BatchSize) {
+        size_t const batchend = std::min(batchstart + BatchSize, numNodes);
+        parallel_for(batchend - batchstart, BlockSize, numWorkers, find_block);
+        for (size_t ii = batchstart; ii < batchend; ii++) {
+            // Get remaining unused descriptor bits up to this node.
+            size_t const basedesc = nodes[ii].get_desc();
+            // Start with the literal/symbolwise encoding of the current node.
+            Relax(ii, basedesc, get_literal(ii));
+            // Get the adjacency list for this node.
+            Node_t const* elem = &found[(ii - batchstart) * numWindows];
+            for (auto& win : winSet) {
+                if (win.find_extra_matches(matches)) {
+                    for (const auto& extra : matches) {
+                        if (extra.get_type() != EdgeType::invalid) {
+                            Relax(ii, basedesc, extra);
+                        }
+                    }
+                } else if (elem->get_type() != EdgeType::invalid) {
+                    RelaxPrefixes(ii, basedesc, *elem, win.getMinMatchLength());
                 }
+                ++elem;
+                win.slideWindow();
             }
-            win.slideWindow();
         }
     }
 
-    // This is what we will produce.
-    AdjList parselist;
+    // Count the edges in the shortest path, so that the parse can be filled
+    // in from the back without moving anything around.
+    size_t numEdges = 0;
+    for (size_t ii = numNodes; ii != 0; ii = nodes[ii].get_parent(ii)) {
+        numEdges++;
+    }
+    parselist.resize(numEdges);
+    auto out = parselist.end();
     for (size_t ii = numNodes; ii != 0;) {
-        // Insert the edge up front...
-        parselist.push_front(pedges[ii]);
+        // Insert the edge before the ones already filled in...
+        size_t const parent = nodes[ii].get_parent(ii);
+        const auto*  ptr    = reinterpret_cast<const uint8_t*>(
+                data + parent + Adaptor::FirstMatchPosition);
+        *--out = nodes[ii].get_edge(ii, read_stream(ptr));
         // ... and switch to parent node.
-        ii = parents[ii];
+        ii = parent;
     }
 
     // We are done: this is the optimal parsing of the input file, giving
@@ -400,74 +1170,104 @@ auto find_optimal_lzss_parse(
     return parselist;
 }
 
+// Same as above, using the default workspace of the calling thread.
+template <typename Adaptor>
+auto const& find_optimal_lzss_parse(
+        uint8_t const* dt, size_t const size, Adaptor adaptor,
+        LZSSEffort const  effort      = LZSSEffort::optimal,
+        size_t const      numthreads  = 1,
+        MatchFinder const matchfinder = Adaptor::MatchFinderType) noexcept {
+    return find_optimal_lzss_parse(
+            dt, size, adaptor, LZSSWorkspace::thread_default(), effort,
+            numthreads, matchfinder);
+}
+
 /*
  * This class abstracts away an LZSS output stream composed of one or more bytes
  * in a descriptor bitfield, followed by byte parameters. It manages the output
- * by buffering the bytes until a descriptor field is full, at which point it
- * writes the descriptor field and flushes the output buffer.
+ * by building the whole compressed stream in a buffer: space for a descriptor
+ * field is set aside when one is started (as defined by the adaptor class), the
+ * parameter bytes are appended after it, and the descriptor field is written
+ * into its place once it is full. The buffer is written to the stream at the
+ * end.
  */
 template <typename Adaptor>
 class LZSSOStream {
 private:
     using descriptor_t        = typename Adaptor::descriptor_t;
     using descriptor_endian_t = typename Adaptor::descriptor_endian_t;
+    constexpr static size_t const NumDescBits
+            = sizeof(descriptor_t) * CHAR_BIT;
     // Where we will output to.
     std::ostream& out;
-    // Internal bitstream output buffer.
-    obitstream<
-            descriptor_t, Adaptor::DescriptorLittleEndianBits,
-            descriptor_endian_t>
-            bits;
-    // Internal parameter buffer.
-    std::string buffer;
-    void        flushbuffer() noexcept {
-        out.write(buffer.c_str(), buffer.size());
-        buffer.clear();
+    // Internal output buffer, which belongs to a workspace.
+    std::vector<uint8_t>& buffer;
+    // Where the current descriptor field goes in the buffer.
+    size_t descpos{0};
+    // Internal descriptor bitfield. Bits are stored in the order in which they
+    // will be written, so that there is nothing to reverse later.
+    descriptor_t bitbuffer{0};
+    size_t       waitingbits{0};
+
+    void start_descriptor() noexcept {
+        descpos = buffer.size();
+        buffer.resize(descpos + sizeof(descriptor_t), 0);
+    }
+    void write_descriptor() noexcept {
+        uint8_t* ptr = buffer.data() + descpos;
+        descriptor_endian_t::template WriteN<uint8_t*, sizeof(descriptor_t)>(
+                ptr, bitbuffer);
+        bitbuffer   = 0;
+        waitingbits = 0;
     }
 
 public:
     // Constructor.
-    explicit LZSSOStream(std::ostream& Dst) noexcept : out(Dst), bits(out) {}
+    explicit LZSSOStream(
+            std::ostream&  Dst,
+            LZSSWorkspace& workspace = LZSSWorkspace::thread_default()) noexcept
+            : out(Dst), buffer(workspace.get<std::vector<uint8_t>>()) {
+        buffer.clear();
+        if (Adaptor::NeedEarlyDescriptor) {
+            start_descriptor();
+        }
+    }
     LZSSOStream(LZSSOStream const&)     = delete;
     LZSSOStream(LZSSOStream&&) noexcept = delete;
     LZSSOStream& operator=(LZSSOStream const&) = delete;
     LZSSOStream& operator=(LZSSOStream&&) noexcept = delete;
     // Destructor: writes anything that hasn't been written.
     ~LZSSOStream() noexcept {
-        // We need a dummy descriptor field if we have exactly zero bits left
-        // on the previous descriptor field; this is because the decoder will
-        // immediately fetch a new descriptor field when the previous one has
-        // expired, and we don't want it to be the terminating sequence.
-        // First, save current state.
-        bool const needdummydesc = !bits.have_waiting_bits();
-        // Now, flush the queue if needed.
-        bits.flush();
-        if (Adaptor::NeedEarlyDescriptor && needdummydesc) {
-            // We need to add a dummy descriptor field; so add it.
-            for (size_t ii = 0; ii < sizeof(descriptor_t); ii++) {
-                out.put(0x00);
-            }
+        // A partial descriptor field is padded with zeroes. If the previous
+        // descriptor field ended exactly on the last bit, and the adaptor
+        // needs early descriptors, the decoder will immediately fetch a new
+        // descriptor field: it has been set aside already, and is left as a
+        // dummy field of zeroes so it isn't the terminating sequence.
+        if (waitingbits != 0U) {
+            write_descriptor();
         }
-        // Now write the terminating sequence if it wasn't written already.
-        flushbuffer();
+        out.write(reinterpret_cast<char const*>(buffer.data()), buffer.size());
     }
     // Writes a bit to the descriptor bitfield. When the descriptor field is
-    // full, outputs it and the output parameter buffer.
+    // full, it is written to the space set aside for it.
     void descbit(descriptor_t const bit) noexcept {
-        if (Adaptor::NeedEarlyDescriptor) {
-            if (bits.push(bit)) {
-                flushbuffer();
-            }
-        } else {
-            if (!bits.have_waiting_bits()) {
-                flushbuffer();
+        if (!Adaptor::NeedEarlyDescriptor && waitingbits == 0U) {
+            start_descriptor();
+        }
+        size_t const shift = Adaptor::DescriptorLittleEndianBits
+                                     ? waitingbits
+                                     : NumDescBits - 1 - waitingbits;
+        bitbuffer |= descriptor_t((bit & 1U) << shift);
+        if (++waitingbits == NumDescBits) {
+            write_descriptor();
+            if (Adaptor::NeedEarlyDescriptor) {
+                start_descriptor();
             }
-            bits.push(bit);
         }
     }
     // Puts a byte in the output buffer.
     void putbyte(size_t const c) noexcept {
-        Write1(buffer, c);
+        buffer.push_back(uint8_t(c));
     }
 };
 
@@ -475,32 +1275,83 @@ class LZSSOStream {
  * This class abstracts away an LZSS input stream composed of one or more bytes
  * in a descriptor bitfield, followed by byte parameters. It manages the input
  * by reading a descriptor field when one is required (as defined by the adaptor
- * class), so that bytes can be read when needed from the input stream.
+ * class), so that bytes can be read when needed from the input buffer. Reading
+ * past the end of the buffer gives zeroes, and makes good() return false.
  */
 template <typename Adaptor>
 class LZSSIStream {
 private:
     using descriptor_t        = typename Adaptor::descriptor_t;
     using descriptor_endian_t = typename Adaptor::descriptor_endian_t;
-    // Where we will input to.
-    std::istream& in;
-    // Internal bitstream input buffer.
-    ibitstream<
-            descriptor_t, Adaptor::NeedEarlyDescriptor,
-            Adaptor::DescriptorLittleEndianBits, descriptor_endian_t>
-            bits;
+    constexpr static size_t const NumDescBits
+            = sizeof(descriptor_t) * CHAR_BIT;
+    // Where we will input from.
+    uint8_t const* const data;
+    size_t const         size;
+    size_t               pos{0};
+    // Internal descriptor bitfield.
+    descriptor_t bitbuffer{0};
+    size_t       readbits{0};
+
+    void check_buffer() noexcept {
+        if (readbits != 0U) {
+            return;
+        }
+        std::array<uint8_t, sizeof(descriptor_t)> bytes{};
+        for (auto& byte : bytes) {
+            byte = getbyte();
+        }
+        uint8_t const*     ptr = bytes.data();
+        descriptor_t const bits
+                = descriptor_endian_t::template ReadN<sizeof(descriptor_t)>(
+                        ptr);
+        bitbuffer = Adaptor::DescriptorLittleEndianBits
+                            ? detail::reverseBits(bits)
+                            : bits;
+        readbits  = NumDescBits;
+    }
 
 public:
     // Constructor.
-    explicit LZSSIStream(std::istream& Src) noexcept : in(Src), bits(in) {}
-    // Writes a bit to the descriptor bitfield. When the descriptor field is
-    // full, it is written out.
+    LZSSIStream(uint8_t const* src, size_t const len) noexcept
+            : data(src), size(len) {
+        check_buffer();
+    }
+    // Reads a bit from the descriptor bitfield. When the descriptor field is
+    // used up, a new one is read.
     descriptor_t descbit() noexcept {
-        return bits.pop();
+        if (!Adaptor::NeedEarlyDescriptor) {
+            check_buffer();
+        }
+        --readbits;
+        descriptor_t const bit = (bitbuffer >> readbits) & 1U;
+        if (Adaptor::NeedEarlyDescriptor) {
+            check_buffer();
+        }
+        return bit;
     }
-    // Puts a byte in the input buffer.
+    // Gets a byte from the input buffer.
     uint8_t getbyte() noexcept {
-        return Read1(in);
+        uint8_t const val = pos < size ? data[pos] : 0;
+        pos++;
+        return val;
+    }
+    // Gets a big-endian word from the input buffer.
+    uint16_t getword() noexcept {
+        uint16_t const high = getbyte();
+        return (high << 8U) | getbyte();
+    }
+    // False if anything was read past the end of the input buffer.
+    bool good() const noexcept {
+        return pos <= size;
+    }
+    // True if the whole input buffer has been read.
+    bool at_end() const noexcept {
+        return pos >= size;
+    }
+    // How much of the input buffer has been read.
+    size_t tell() const noexcept {
+        return std::min(pos, size);
     }
 };
 
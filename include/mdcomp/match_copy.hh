@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) Flamewing 2021 <flamewing.sonic@gmail.com>
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_MATCH_COPY_HH
+#define LIB_MATCH_COPY_HH
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace detail {
+    // Fills [out, out + length) with copies of the period bytes before out,
+    // for a period that divides 8: the pattern is spread over a 64-bit word,
+    // which is then stored 8 bytes at a time.
+    inline void broadcast_pattern(
+            uint8_t* out, size_t const period, size_t const length) noexcept {
+        uint64_t pattern = 0;
+        auto*    bytes   = reinterpret_cast<uint8_t*>(&pattern);
+        for (size_t ii = 0; ii < sizeof(pattern); ii++) {
+            bytes[ii] = (out - period)[ii % period];
+        }
+        size_t done = 0;
+        for (; done + sizeof(pattern) <= length; done += sizeof(pattern)) {
+            std::memcpy(out + done, &pattern, sizeof(pattern));
+        }
+        std::memcpy(out + done, &pattern, length - done);
+    }
+
+    // Fills [out, out + length) with copies of the distance bytes before out.
+    // Each pass copies everything written so far that is still part of the
+    // pattern, so the chunks grow until they cover the rest of the match; no
+    // chunk overlaps the bytes it is copied from.
+    inline void replicate_pattern(
+            uint8_t* out, size_t const distance, size_t const length) noexcept {
+        uint8_t const* const src  = out - distance;
+        size_t               done = 0;
+        while (done < length) {
+            size_t const count = std::min(done + distance, length - done);
+            std::memcpy(out + done, src, count);
+            done += count;
+        }
+    }
+}    // namespace detail
+
+/*
+ * Appends a dictionary match of length bytes to the output, starting distance
+ * bytes before its end. The match may overlap the bytes it produces, as when
+ * a run of a single byte or a repeating pattern is encoded as a match with a
+ * distance shorter than its length. The distance must be between 1 and the
+ * size of the output.
+ */
+inline void copy_match(
+        std::vector<uint8_t>& Dst, size_t const distance,
+        size_t const length) noexcept {
+    size_t const start = Dst.size();
+    Dst.resize(start + length);
+    uint8_t* const out = Dst.data() + start;
+    if (distance >= length) {
+        // No overlap: a plain copy will do.
+        std::memcpy(out, out - distance, length);
+    } else if (distance == 1) {
+        // A run of a single byte.
+        std::memset(out, out[-1], length);
+    } else if (distance == 2 || distance == 4) {
+        detail::broadcast_pattern(out, distance, length);
+    } else {
+        detail::replicate_pattern(out, distance, length);
+    }
+}
+
+// Same as above, for formats made of 16-bit words (such as Comper): both the
+// distance and the length of the match are in words.
+inline void copy_match_words(
+        std::vector<uint8_t>& Dst, size_t const distance,
+        size_t const length) noexcept {
+    copy_match(Dst, 2 * distance, 2 * length);
+}
+
+#endif    // LIB_MATCH_COPY_HH
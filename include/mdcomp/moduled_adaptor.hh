@@ -21,11 +21,19 @@
 #define LIB_MODULED_ADAPTOR_HH
 
 #include <mdcomp/bigendian_io.hh>
+#include <mdcomp/ignore_unused_variable_warning.hh>
+#include <mdcomp/parallel.hh>
 
+#include <algorithm>
+#include <atomic>
 #include <limits>
 #include <sstream>
+#include <string>
+#include <type_traits>
 #include <vector>
 
+class LZSSWorkspace;
+
 template <
         typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
 class ModuledAdaptor {
@@ -34,90 +42,377 @@ class ModuledAdaptor {
         ModuleSize    = DefaultModuleSize,
         ModulePadding = DefaultModulePadding
     };
-    static size_t PadMaskBits;
-    static bool   moduled_decode(
-              std::istream& Src, std::iostream& Dst,
-              size_t ModulePadding = DefaultModulePadding);
+    // Where each module starts, counted from the start of the moduled data
+    // (that is, the first module is at offset 2, after the size).
+    using ModuleIndex = std::vector<size_t>;
+
+    static bool moduled_decode(
+            std::istream& Src, std::iostream& Dst,
+            size_t ModulePadding = DefaultModulePadding);
+    // Decodes all modules at the same time on up to numthreads threads, using
+    // an index of where they start; module k decodes to offset k * ModuleSize
+    // of the output. Returns false, writing nothing, if the index or a module
+    // does not fit the data.
+    static bool moduled_decode(
+            std::istream& Src, std::iostream& Dst, ModuleIndex const& index,
+            size_t numthreads = hardware_thread_count());
+    // Decodes only the given module, reading only the size and its own
+    // compressed data. Returns false, writing nothing, if the index or the
+    // module does not fit the data.
+    static bool moduled_decode_module(
+            std::istream& Src, std::iostream& Dst, ModuleIndex const& index,
+            size_t module);
+    // Finds where each module starts. None of the formats record the size of
+    // the compressed data, so this has to decode each module, but only once;
+    // it is cheaper to save the index made by moduled_encode alongside the
+    // file. Src is left where it was.
+    static ModuleIndex moduled_index(
+            std::istream& Src, size_t ModulePadding = DefaultModulePadding);
 
+    // The modules are encoded at the same time on up to numthreads threads,
+    // and each module is encoded on a single thread. Any options after the
+    // thread count are passed along to the format's encoder, for each module,
+    // so they must be safe to share between the threads; an LZSS workspace is
+    // not, and is rejected, so that each thread uses its own default
+    // workspace.
+    template <typename... Options>
     static bool moduled_encode(
             std::istream& Src, std::ostream& Dst,
-            size_t ModulePadding = DefaultModulePadding);
+            size_t ModulePadding = DefaultModulePadding,
+            size_t numthreads = hardware_thread_count(), Options&&... options);
+    // Same as above, but also fills index with where each module starts.
+    template <typename... Options>
+    static bool moduled_encode(
+            std::istream& Src, std::ostream& Dst, ModuleIndex& index,
+            size_t ModulePadding = DefaultModulePadding,
+            size_t numthreads = hardware_thread_count(), Options&&... options);
+
+protected:
+    // Encodes a single module. PadMaskBits is a mask of the bits of the
+    // encoded size, in bits, that the padding after the module clears.
+    // Formats that take the padding into account when encoding, or that can
+    // encode on several threads, provide their own version of this.
+    template <typename... Options>
+    static bool encode_module(
+            std::ostream& Dst, uint8_t const* data, size_t Size,
+            size_t PadMaskBits, Options&&... options);
+
+private:
+    // How many modules there are in data of the given size; even empty data
+    // has one.
+    constexpr static size_t module_count(size_t const FullSize) noexcept {
+        return FullSize > ModuleSize ? (FullSize - 1) / ModuleSize + 1 : 1;
+    }
+    // How many bytes the given module decodes to; only the last is short.
+    constexpr static size_t module_length(
+            size_t const module, size_t const FullSize) noexcept {
+        return std::min(
+                size_t(ModuleSize),
+                FullSize - std::min(FullSize, module * ModuleSize));
+    }
+    // Whether decoded bytes are right for the given module; the last one
+    // may have some padding at the end.
+    constexpr static bool fits_module(
+            size_t const decoded, size_t const module,
+            size_t const FullSize) noexcept {
+        return module + 1 < module_count(FullSize)
+                       ? decoded == module_length(module, FullSize)
+                       : decoded >= module_length(module, FullSize);
+    }
+    // Whether the index has a start for each module, in order, and inside
+    // the Size bytes that follow the size.
+    static bool fits_index(
+            ModuleIndex const& index, size_t FullSize, size_t Size) noexcept;
+    // Decodes the modules one after the other, appending them to Dst and
+    // their starts to index.
+    static void decode_in_order(
+            std::vector<uint8_t> const& data, size_t FullSize,
+            size_t ModulePadding, std::vector<uint8_t>& Dst,
+            ModuleIndex& index);
+    // Whether any of the options is an LZSS workspace.
+    template <typename... Options>
+    constexpr static bool has_workspace() noexcept {
+        bool const found[]
+                = {false,
+                   std::is_same<std::decay_t<Options>, LZSSWorkspace>::value...};
+        for (bool const elem : found) {
+            if (elem) {
+                return true;
+            }
+        }
+        return false;
+    }
 };
 
 template <
         typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
 bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
-        moduled_decode(
-                std::istream& Src, std::iostream& Dst,
-                size_t const ModulePadding) {
-    int64_t const     FullSize = BigEndian::Read2(Src);
-    std::stringstream in(std::ios::in | std::ios::out | std::ios::binary);
-    in << Src.rdbuf();
-
-    // Pad to even length, for safety.
-    if ((in.tellp() % 2) != 0) {
-        in.put(0);
+        fits_index(
+                ModuleIndex const& index, size_t const FullSize,
+                size_t const Size) noexcept {
+    if (index.size() != module_count(FullSize) || index[0] != 2) {
+        return false;
     }
+    for (size_t ii = 1; ii < index.size(); ii++) {
+        if (index[ii] <= index[ii - 1]) {
+            return false;
+        }
+    }
+    return index.back() - 2 <= Size;
+}
 
-    in.seekg(0);
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+void ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        decode_in_order(
+                std::vector<uint8_t> const& data, size_t const FullSize,
+                size_t const ModulePadding, std::vector<uint8_t>& Dst,
+                ModuleIndex& index) {
     size_t const PadMask = ModulePadding - 1;
+    size_t       pos     = 0;
 
     while (true) {
-        Format::decode(in, Dst);
-        if (Dst.tellp() >= FullSize) {
+        index.push_back(pos + 2);
+        size_t const used
+                = Format::decode(data.data() + pos, data.size() - pos, Dst);
+        pos += used;
+        // Also stop on broken data, which would otherwise never end.
+        if (Dst.size() >= FullSize || used == 0 || pos >= data.size()) {
             break;
         }
 
         // Skip padding between modules
-        size_t const paddingEnd = (size_t(in.tellg()) + PadMask) & ~PadMask;
-        in.seekg(paddingEnd);
+        pos = std::min((pos + PadMask) & ~PadMask, data.size());
     }
+}
+
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        moduled_decode(
+                std::istream& Src, std::iostream& Dst,
+                size_t const ModulePadding) {
+    size_t const         FullSize = BigEndian::Read2(Src);
+    std::vector<uint8_t> data;
+    Format::extract(Src, data);
 
+    std::vector<uint8_t> out;
+    ModuleIndex          index;
+    decode_in_order(data, FullSize, ModulePadding, out, index);
+    Dst.write(
+            reinterpret_cast<char const*>(out.data()),
+            std::streamsize(out.size()));
     return true;
 }
 
 template <
         typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        moduled_decode(
+                std::istream& Src, std::iostream& Dst,
+                ModuleIndex const& index, size_t const numthreads) {
+    size_t const         FullSize = BigEndian::Read2(Src);
+    std::vector<uint8_t> data;
+    Format::extract(Src, data);
+    if (!fits_index(index, FullSize, data.size())) {
+        return false;
+    }
+
+    // Each module is decoded straight from the input, and goes to its own
+    // slot of the output.
+    size_t const         numModules = index.size();
+    std::vector<uint8_t> out(FullSize);
+    std::atomic<bool>    good{true};
+    parallel_for(
+            numModules, 1, std::min(numthreads, numModules),
+            [&](size_t const first, size_t const last) {
+                std::vector<uint8_t> module;
+                for (size_t ii = first; ii < last && good; ii++) {
+                    size_t const start = index[ii] - 2;
+                    size_t const end   = ii + 1 < numModules ? index[ii + 1] - 2
+                                                             : data.size();
+                    size_t const length = module_length(ii, FullSize);
+                    module.clear();
+                    Format::decode(
+                            data.data() + start,
+                            std::min(end, data.size()) - start, module);
+                    if (!fits_module(module.size(), ii, FullSize)) {
+                        good = false;
+                        break;
+                    }
+                    std::copy_n(
+                            module.cbegin(), length,
+                            out.begin() + ii * ModuleSize);
+                }
+            });
+
+    if (!good) {
+        return false;
+    }
+    Dst.write(
+            reinterpret_cast<char const*>(out.data()),
+            std::streamsize(out.size()));
+    return true;
+}
+
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        moduled_decode_module(
+                std::istream& Src, std::iostream& Dst,
+                ModuleIndex const& index, size_t const module) {
+    size_t const Location = Src.tellg();
+    size_t const FullSize = BigEndian::Read2(Src);
+    if (!Src.good() || index.size() != module_count(FullSize)
+        || module >= index.size()) {
+        return false;
+    }
+    bool const   last  = module + 1 == index.size();
+    size_t const start = index[module];
+    size_t const end   = last ? start : index[module + 1];
+    if (start < 2 || (!last && end <= start)) {
+        return false;
+    }
+    Src.seekg(Location + start);
+    if (!Src.good()) {
+        return false;
+    }
+
+    std::vector<uint8_t> data;
+    if (!last) {
+        data.resize(end - start);
+        Src.read(reinterpret_cast<char*>(data.data()), data.size());
+        if (size_t(Src.gcount()) != data.size()) {
+            return false;
+        }
+    } else {
+        Format::extract(Src, data);
+        if (data.empty()) {
+            return false;
+        }
+    }
+
+    std::vector<uint8_t> out;
+    Format::decode(data.data(), data.size(), out);
+    if (!fits_module(out.size(), module, FullSize)) {
+        return false;
+    }
+    Dst.write(
+            reinterpret_cast<char const*>(out.data()),
+            std::streamsize(module_length(module, FullSize)));
+    return true;
+}
+
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+auto ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        moduled_index(std::istream& Src, size_t const ModulePadding)
+                -> ModuleIndex {
+    size_t const         Location = Src.tellg();
+    size_t const         FullSize = BigEndian::Read2(Src);
+    std::vector<uint8_t> data;
+    Format::extract(Src, data);
+    Src.clear();
+    Src.seekg(Location);
+
+    std::vector<uint8_t> out;
+    ModuleIndex          index;
+    decode_in_order(data, FullSize, ModulePadding, out, index);
+    return index;
+}
+
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+template <typename... Options>
 bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
         moduled_encode(
                 std::istream& Src, std::ostream& Dst,
-                size_t const ModulePadding) {
+                size_t const ModulePadding, size_t const numthreads,
+                Options&&... options) {
+    ModuleIndex index;
+    return moduled_encode(
+            Src, Dst, index, ModulePadding, numthreads,
+            std::forward<Options>(options)...);
+}
+
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+template <typename... Options>
+bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        moduled_encode(
+                std::istream& Src, std::ostream& Dst, ModuleIndex& index,
+                size_t const ModulePadding, size_t const numthreads,
+                Options&&... options) {
+    static_assert(
+            !has_workspace<Options...>(),
+            "An LZSSWorkspace can't be shared by the threads that encode the "
+            "modules; leave it out to use the default one of each thread.");
     size_t Location = Src.tellg();
     Src.ignore(std::numeric_limits<std::streamsize>::max());
-    size_t FullSize = Src.gcount();
+    size_t const FullSize = Src.gcount();
     Src.seekg(Location);
     std::vector<uint8_t> data;
     data.resize(FullSize);
-    auto ptr = data.cbegin();
-    Src.read(reinterpret_cast<char*>(&(data.front())), data.size());
+    Src.read(reinterpret_cast<char*>(data.data()), data.size());
 
     size_t const PadMask = ModulePadding - 1;
 
+    // All modules but the last are full-sized; the modules do not depend on
+    // each other, so they are all encoded at once.
+    size_t const             numModules = module_count(FullSize);
+    std::vector<std::string> modules(numModules);
+    parallel_for(
+            numModules, 1, std::min(numthreads, numModules),
+            [&](size_t const first, size_t const last) {
+                for (size_t ii = first; ii < last; ii++) {
+                    size_t const start  = ii * ModuleSize;
+                    size_t const length = module_length(ii, FullSize);
+                    // We want to manage internal padding for all modules but
+                    // the last.
+                    size_t const PadMaskBits
+                            = ii + 1 < numModules ? 8 * ModulePadding - 1U
+                                                  : 7U;
+                    std::stringstream sout(
+                            std::ios::in | std::ios::out | std::ios::binary);
+                    Format::encode_module(
+                            sout, data.data() + start, length, PadMaskBits,
+                            options...);
+                    modules[ii] = sout.str();
+                }
+            });
+
     BigEndian::Write2(Dst, FullSize);
-    std::stringstream sout(std::ios::in | std::ios::out | std::ios::binary);
-
-    while (FullSize > ModuleSize) {
-        // We want to manage internal padding for all modules but the last.
-        PadMaskBits = 8 * ModulePadding - 1U;
-        Format::encode(sout, &(*ptr), ModuleSize);
-        FullSize -= ModuleSize;
-        ptr += ModuleSize;
-
-        // Padding between modules
-        int64_t const paddingEnd = (size_t(sout.tellp()) + PadMask) & ~PadMask;
-        for (; sout.tellp() < paddingEnd; sout.put(0)) {
+    index.clear();
+    size_t written = 0;
+    for (size_t ii = 0; ii < numModules; ii++) {
+        index.push_back(written + 2);
+        Dst.write(modules[ii].data(), std::streamsize(modules[ii].size()));
+        written += modules[ii].size();
+        if (ii + 1 < numModules) {
+            // Padding between modules
+            size_t const paddingEnd = (written + PadMask) & ~PadMask;
+            for (; written < paddingEnd; written++) {
+                Dst.put(0);
+            }
         }
     }
 
-    PadMaskBits = 7U;
-    Format::encode(sout, &(*ptr), FullSize);
-
     // Pad to even size.
-    Dst << sout.rdbuf();
     if ((Dst.tellp() % 2) != 0) {
         Dst.put(0);
     }
     return true;
 }
 
+template <
+        typename Format, size_t DefaultModuleSize, size_t DefaultModulePadding>
+template <typename... Options>
+bool ModuledAdaptor<Format, DefaultModuleSize, DefaultModulePadding>::
+        encode_module(
+                std::ostream& Dst, uint8_t const* data, size_t const Size,
+                size_t const PadMaskBits, Options&&... options) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return Format::encode(Dst, data, Size, std::forward<Options>(options)...);
+}
+
 #endif    // LIB_MODULED_ADAPTOR_HH
@@ -25,6 +25,12 @@
 
 #include <iosfwd>
 
+// How many ways of building the code table the Nemesis encoder tries. The
+// extended search tries twice as many, which can give a smaller file. None of
+// them is cut short, so it takes up to twice as long, unless there are enough
+// threads to run all attempts at once.
+enum class NemesisSearch { standard, extended };
+
 class nemesis;
 using basic_nemesis   = BasicDecoder<nemesis, PadMode::DontPad>;
 using moduled_nemesis = ModuledAdaptor<nemesis, 4096U, 1U>;
@@ -32,10 +38,16 @@ using moduled_nemesis = ModuledAdaptor<nemesis, 4096U, 1U>;
 class nemesis : public basic_nemesis, public moduled_nemesis {
     friend basic_nemesis;
     friend moduled_nemesis;
-    static bool encode(std::ostream& Dst, uint8_t const* data, size_t Size);
+    static bool encode(
+            std::ostream& Dst, uint8_t const* data, size_t Size,
+            NemesisSearch search = NemesisSearch::standard);
+    static size_t decode(
+            uint8_t const* data, size_t Size, std::vector<uint8_t>& Dst);
 
 public:
-    static bool encode(std::istream& Src, std::ostream& Dst);
+    static bool encode(
+            std::istream& Src, std::ostream& Dst,
+            NemesisSearch search = NemesisSearch::standard);
     static bool decode(std::istream& Src, std::ostream& Dst);
 };
 
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Flamewing 2021 <flamewing.sonic@gmail.com>
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_PARALLEL_HH
+#define LIB_PARALLEL_HH
+
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+// Number of threads the hardware can run at once, or 1 if it is unknown.
+inline size_t hardware_thread_count() noexcept {
+    return std::max(size_t(std::thread::hardware_concurrency()), size_t(1));
+}
+
+/*
+ * Calls func(first, last) for consecutive blocks of at most blocksize items
+ * that cover the [0, count) range, using up to numthreads threads; the calling
+ * thread is one of them. Threads take the next block as soon as they finish
+ * the previous one, so uneven blocks still keep all threads busy. Blocks can
+ * run in any order, so func must not depend on it.
+ *
+ * If the system refuses to start more threads, the work is split among those
+ * that did start; in the worst case, the calling thread does all of it.
+ */
+template <typename Func>
+void parallel_for(
+        size_t const count, size_t const blocksize, size_t const numthreads,
+        Func&& func) noexcept {
+    size_t const numblocks = (count + blocksize - 1) / blocksize;
+    std::atomic<size_t> next{0};
+    auto worker = [&]() noexcept {
+        for (size_t block = next++; block < numblocks; block = next++) {
+            size_t const first = block * blocksize;
+            func(first, std::min(first + blocksize, count));
+        }
+    };
+    std::vector<std::thread> threads;
+    size_t const numworkers = std::min(numthreads, numblocks);
+    if (numworkers > 1) {
+        threads.reserve(numworkers - 1);
+        try {
+            while (threads.size() < numworkers - 1) {
+                threads.emplace_back(worker);
+            }
+        } catch (std::system_error const&) {
+            // Make do with the threads we have.
+        }
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+#endif    // LIB_PARALLEL_HH
@@ -32,6 +32,8 @@ class snkrle : public basic_snkrle, public moduled_snkrle {
     friend basic_snkrle;
     friend moduled_snkrle;
     static bool encode(std::ostream& Dst, uint8_t const* data, size_t Size);
+    static size_t decode(
+            uint8_t const* data, size_t Size, std::vector<uint8_t>& Dst);
 
 public:
     using basic_snkrle::encode;
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) Flamewing 2021 <flamewing.sonic@gmail.com>
+ *
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_SUFFIX_ARRAY_HH
+#define LIB_SUFFIX_ARRAY_HH
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#ifdef __GNUG__
+#    define ATTR_PURE __attribute__((pure))
+#else
+#    define ATTR_PURE
+#endif
+
+/*
+ * Suffix array and longest common prefix array of a whole file, plus the
+ * auxiliary structures needed to answer "what is the longest match for this
+ * position starting at most W characters back" in logarithmic time.
+ *
+ * Positions are added to the index in increasing order with insert_until; a
+ * query only sees positions that have already been added.
+ */
+template <typename stream_t>
+class SuffixArray {
+public:
+    constexpr static size_t const npos = std::numeric_limits<size_t>::max();
+
+    SuffixArray(stream_t const* dt, size_t const size) noexcept
+            : data(dt), nlen(size), leaves(get_num_leaves(size)),
+              lcptree(2 * leaves, 0), postree(2 * leaves, 0) {
+        build_suffix_array();
+        build_lcp_array();
+    }
+
+    // Adds all positions before pos to the index.
+    void insert_until(size_t const pos) noexcept {
+        for (; inserted < pos && inserted < nlen; inserted++) {
+            // Positions are stored plus one, so that zero means "absent".
+            size_t node   = leaves + rank[inserted];
+            postree[node] = inserted + 1;
+            for (node >>= 1U; node != 0; node >>= 1U) {
+                postree[node]
+                        = std::max(postree[2 * node], postree[2 * node + 1]);
+            }
+        }
+    }
+
+    // Finds the longest match for pos, up to end characters long, that starts
+    // in the [lbound, pos) range. Among all matches with this length, the
+    // closest one is picked. If there is no match, best_len is left alone.
+    void find_longest_match(
+            size_t const pos, size_t const lbound, size_t const end,
+            size_t& best_pos, size_t& best_len) noexcept {
+        insert_until(pos);
+        size_t const rk     = rank[pos];
+        size_t const thresh = lbound + 1;
+        // As the common prefix can only get shorter the farther away two
+        // suffixes are in the suffix array, the longest match is given by
+        // the closest suffix in the window on either side.
+        size_t       len  = 0;
+        size_t const left = find_last_position(rk, thresh);
+        if (left != npos) {
+            len = min_lcp(left + 1, rk + 1);
+        }
+        size_t const right = find_first_position(rk + 1, thresh);
+        if (right != npos) {
+            len = std::max(len, min_lcp(rk + 1, right + 1));
+        }
+        len = std::min(len, end);
+        if (len == 0 || len <= best_len) {
+            return;
+        }
+        // All suffixes that have at least len characters in common with pos
+        // form a contiguous range in the suffix array; the closest match is
+        // the one that was added last.
+        size_t const first = find_last_short_lcp(rk + 1, len);
+        size_t const last  = find_first_short_lcp(rk + 1, len);
+        best_pos           = max_position(first, last) - 1;
+        best_len           = len;
+    }
+
+private:
+    static size_t get_num_leaves(size_t const size) noexcept {
+        size_t count = 1;
+        while (count < size) {
+            count <<= 1U;
+        }
+        return count;
+    }
+
+    // Sorts all suffixes by prefix doubling with counting sorts. This sorts
+    // cyclic shifts of the data with a sentinel added, which is the same as
+    // sorting the suffixes.
+    void build_suffix_array() noexcept {
+        if (nlen == 0) {
+            // Nothing to sort; this also avoids allocating the buckets when
+            // the index is not going to be used.
+            return;
+        }
+        size_t const count = nlen + 1;
+        std::vector<size_t> shifts(count);
+        std::vector<size_t> classes(count);
+        std::vector<size_t> buckets(
+                std::max(count, size_t(std::numeric_limits<stream_t>::max())
+                                        + 2));
+        // Sentinel is class 0, everything else is shifted up by one.
+        auto symbol = [&](size_t const ii) -> size_t {
+            return ii == nlen ? 0 : size_t(data[ii]) + 1;
+        };
+        for (size_t ii = 0; ii < count; ii++) {
+            buckets[symbol(ii)]++;
+        }
+        for (size_t ii = 1; ii < buckets.size(); ii++) {
+            buckets[ii] += buckets[ii - 1];
+        }
+        for (size_t ii = count; ii-- > 0;) {
+            shifts[--buckets[symbol(ii)]] = ii;
+        }
+        size_t numclasses  = 1;
+        classes[shifts[0]] = 0;
+        for (size_t ii = 1; ii < count; ii++) {
+            if (symbol(shifts[ii]) != symbol(shifts[ii - 1])) {
+                numclasses++;
+            }
+            classes[shifts[ii]] = numclasses - 1;
+        }
+        std::vector<size_t> newshifts(count);
+        std::vector<size_t> newclasses(count);
+        for (size_t half = 1; half < count && numclasses < count;
+             half <<= 1U) {
+            // Sort by the second half: shifting the sorted order left does it.
+            for (size_t ii = 0; ii < count; ii++) {
+                newshifts[ii] = (shifts[ii] + count - half) % count;
+            }
+            // Stable sort by the first half.
+            std::fill_n(buckets.begin(), numclasses, 0);
+            for (size_t ii = 0; ii < count; ii++) {
+                buckets[classes[newshifts[ii]]]++;
+            }
+            for (size_t ii = 1; ii < numclasses; ii++) {
+                buckets[ii] += buckets[ii - 1];
+            }
+            for (size_t ii = count; ii-- > 0;) {
+                shifts[--buckets[classes[newshifts[ii]]]] = newshifts[ii];
+            }
+            // And compute the new equivalence classes.
+            numclasses            = 1;
+            newclasses[shifts[0]] = 0;
+            for (size_t ii = 1; ii < count; ii++) {
+                size_t const curr = shifts[ii];
+                size_t const prev = shifts[ii - 1];
+                if (classes[curr] != classes[prev]
+                    || classes[(curr + half) % count]
+                               != classes[(prev + half) % count]) {
+                    numclasses++;
+                }
+                newclasses[curr] = numclasses - 1;
+            }
+            classes.swap(newclasses);
+        }
+        // The sentinel comes first; drop it.
+        suffixes.assign(shifts.begin() + 1, shifts.end());
+        rank.resize(nlen);
+        for (size_t ii = 0; ii < nlen; ii++) {
+            rank[suffixes[ii]] = ii;
+        }
+    }
+
+    // Kasai's algorithm. Entry ii of the LCP array is the length of the common
+    // prefix between the suffixes of ranks ii - 1 and ii; entry 0 is zero.
+    void build_lcp_array() noexcept {
+        size_t len = 0;
+        for (size_t ii = 0; ii < nlen; ii++) {
+            size_t const rk = rank[ii];
+            if (rk == 0) {
+                len = 0;
+                continue;
+            }
+            size_t const prev = suffixes[rk - 1];
+            while (ii + len < nlen && prev + len < nlen
+                   && data[ii + len] == data[prev + len]) {
+                len++;
+            }
+            lcptree[leaves + rk] = len;
+            if (len > 0) {
+                len--;
+            }
+        }
+        for (size_t node = leaves; node-- > 1;) {
+            lcptree[node] = std::min(lcptree[2 * node], lcptree[2 * node + 1]);
+        }
+    }
+
+    // Minimum of the LCP array in the [first, last) range.
+    size_t min_lcp(size_t first, size_t last) const noexcept {
+        size_t result = npos;
+        for (first += leaves, last += leaves; first < last;
+             first >>= 1U, last >>= 1U) {
+            if ((first & 1U) != 0) {
+                result = std::min(result, lcptree[first++]);
+            }
+            if ((last & 1U) != 0) {
+                result = std::min(result, lcptree[--last]);
+            }
+        }
+        return result;
+    }
+
+    // Maximum stored position (plus one) in the [first, last) range.
+    size_t max_position(size_t first, size_t last) const noexcept {
+        size_t result = 0;
+        for (first += leaves, last += leaves; first < last;
+             first >>= 1U, last >>= 1U) {
+            if ((first & 1U) != 0) {
+                result = std::max(result, postree[first++]);
+            }
+            if ((last & 1U) != 0) {
+                result = std::max(result, postree[--last]);
+            }
+        }
+        return result;
+    }
+
+    // Descends from a node to its rightmost (or leftmost) leaf that satisfies
+    // the predicate; the node itself must satisfy it.
+    template <typename Tree, typename Pred>
+    ATTR_PURE size_t descend(
+            Tree const& tree, size_t node, bool const rightmost,
+            Pred&& pred) const noexcept {
+        while (node < leaves) {
+            size_t const first  = 2 * node + (rightmost ? 1U : 0U);
+            size_t const second = 2 * node + (rightmost ? 0U : 1U);
+            node                = pred(tree[first]) ? first : second;
+        }
+        return node - leaves;
+    }
+
+    // Finds the last rank in [0, last) whose predicate is true.
+    template <typename Tree, typename Pred>
+    ATTR_PURE size_t find_last(
+            Tree const& tree, size_t const last, Pred&& pred) const noexcept {
+        if (last == leaves) {
+            // The whole tree; the loop below never looks at the root.
+            return pred(tree[1]) ? descend(tree, 1, true, pred) : npos;
+        }
+        // Nodes on the right border are visited from right to left.
+        for (size_t first = leaves, node = leaves + last; first < node;
+             first >>= 1U, node >>= 1U) {
+            if ((node & 1U) != 0 && pred(tree[--node])) {
+                return descend(tree, node, true, pred);
+            }
+        }
+        return npos;
+    }
+
+    // Finds the first rank in [first, leaves) whose predicate is true.
+    template <typename Tree, typename Pred>
+    ATTR_PURE size_t find_first(
+            Tree const& tree, size_t const first, Pred&& pred) const noexcept {
+        // Nodes on the left border are visited from left to right.
+        for (size_t node = leaves + first, last = 2 * leaves; node < last;
+             node >>= 1U, last >>= 1U) {
+            if ((node & 1U) != 0 && pred(tree[node++])) {
+                return descend(tree, node - 1, false, pred);
+            }
+        }
+        return npos;
+    }
+
+    ATTR_PURE size_t find_last_position(
+            size_t const last, size_t const thresh) const noexcept {
+        return find_last(postree, last, [thresh](size_t const val) {
+            return val >= thresh;
+        });
+    }
+
+    ATTR_PURE size_t find_first_position(
+            size_t const first, size_t const thresh) const noexcept {
+        return find_first(postree, first, [thresh](size_t const val) {
+            return val >= thresh;
+        });
+    }
+
+    // First rank of the range of suffixes that share len characters with the
+    // suffix of rank last - 1.
+    ATTR_PURE size_t find_last_short_lcp(
+            size_t const last, size_t const len) const noexcept {
+        // Entry 0 is always zero, so this always finds something.
+        return find_last(lcptree, last, [len](size_t const val) {
+            return val < len;
+        });
+    }
+
+    // One past the last rank of the range of suffixes that share len
+    // characters with the suffix of rank first - 1.
+    ATTR_PURE size_t find_first_short_lcp(
+            size_t const first, size_t const len) const noexcept {
+        size_t const found
+                = find_first(lcptree, first, [len](size_t const val) {
+                      return val < len;
+                  });
+        return std::min(found, nlen);
+    }
+
+    stream_t const* const data;
+    size_t const          nlen;
+    size_t const          leaves;
+    // Positions of the suffixes, in sorted order.
+    std::vector<size_t> suffixes;
+    // Sorted order of the suffix starting at each position.
+    std::vector<size_t> rank;
+    // Segment tree for range minimum queries on the LCP array.
+    std::vector<size_t> lcptree;
+    // Segment tree for range maximum queries on the positions that have been
+    // added, indexed by rank.
+    std::vector<size_t> postree;
+    // All positions before this one have been added.
+    size_t inserted{0};
+};
+
+template <typename stream_t>
+constexpr size_t const SuffixArray<stream_t>::npos;
+
+#endif    // LIB_SUFFIX_ARRAY_HH
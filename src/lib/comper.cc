@@ -21,25 +21,22 @@
 #include <mdcomp/comper.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 
 #include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <vector>
 
 using std::array;
-using std::ios;
 using std::iostream;
 using std::istream;
 using std::make_signed_t;
 using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
-using std::stringstream;
-
-template <>
-size_t moduled_comper::PadMaskBits = 1U;
+using std::vector;
 
 class comper_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -67,6 +64,9 @@ class comper_internal {
         constexpr static bool const DescriptorLittleEndianBits = false;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 256;
         // Size of the look-ahead buffer.
@@ -121,42 +121,49 @@ class comper_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst) {
         using CompIStream = LZSSIStream<ComperAdaptor>;
 
-        CompIStream src(in);
+        CompIStream src(Data, Size);
 
-        while (in.good()) {
+        while (src.good()) {
             if (src.descbit() == 0U) {
                 // Symbolwise match.
-                BigEndian::Write2(Dst, BigEndian::Read2(in));
+                uint16_t const Word = src.getword();
+                Dst.push_back(Word >> 8U);
+                Dst.push_back(Word & 0xFFU);
             } else {
                 // Dictionary match.
                 // Distance and length of match.
-                size_t const distance = (size_t(0x100) - src.getbyte()) * 2;
+                size_t const distance = size_t(0x100) - src.getbyte();
                 size_t const length   = src.getbyte();
                 if (length == 0) {
                     break;
                 }
-
-                for (size_t i = 0; i <= length; i++) {
-                    size_t const Pointer = Dst.tellp();
-                    Dst.seekg(Pointer - distance);
-                    uint16_t const Word = BigEndian::Read2(Dst);
-                    Dst.seekp(Pointer);
-                    BigEndian::Write2(Dst, Word);
+                if (2 * distance > Dst.size()) {
+                    // Corrupt data: the match starts before the output.
+                    break;
                 }
+
+                copy_match_words(Dst, distance, length + 1);
             }
         }
+        return src.tell();
     }
 
-    static void encode(ostream& Dst, uint8_t const* Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const* Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType    = typename ComperAdaptor::EdgeType;
         using CompOStream = LZSSOStream<ComperAdaptor>;
 
         // Compute optimal Comper parsing of input file.
-        auto        list = find_optimal_lzss_parse(Data, Size, ComperAdaptor{});
-        CompOStream out(Dst);
+        auto const&  list = find_optimal_lzss_parse(
+                Data, Size, ComperAdaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        CompOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -195,16 +202,36 @@ class comper_internal {
 };
 
 bool comper::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    comper_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = comper_internal::decode(
+            in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool comper::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
-    comper_internal::encode(Dst, data, Size);
+size_t comper::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return comper_internal::decode(data, Size, Dst);
+}
+
+bool comper::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
+    comper_internal::encode(
+            Dst, data, Size, effort, numthreads, matchfinder, workspace);
     return true;
 }
+
+bool comper::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, effort, 1, matchfinder);
+}
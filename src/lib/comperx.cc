@@ -21,25 +21,22 @@
 #include <mdcomp/comperx.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 
 #include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <vector>
 
 using std::array;
-using std::ios;
 using std::iostream;
 using std::istream;
 using std::make_signed_t;
 using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
-using std::stringstream;
-
-template <>
-size_t moduled_comperx::PadMaskBits = 1U;
+using std::vector;
 
 class comperx_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -67,6 +64,9 @@ class comperx_internal {
         constexpr static bool const DescriptorLittleEndianBits = false;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 256;
         // Size of the look-ahead buffer.
@@ -121,15 +121,18 @@ class comperx_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst) {
         using CompIStream = LZSSIStream<ComperXAdaptor>;
 
-        CompIStream src(in);
+        CompIStream src(Data, Size);
 
-        while (in.good()) {
+        while (src.good()) {
             if (src.descbit() == 0U) {
                 // Symbolwise match.
-                BigEndian::Write2(Dst, BigEndian::Read2(in));
+                uint16_t const Word = src.getword();
+                Dst.push_back(Word >> 8U);
+                Dst.push_back(Word & 0xFFU);
             } else {
                 // Dictionary match.
                 // Distance and length of match.
@@ -141,28 +144,32 @@ class comperx_internal {
                 }
 
                 size_t const distance
-                        = raw_dist != 0U ? (0x100 - raw_dist + 1) * 2 : 2;
+                        = raw_dist != 0U ? (0x100 - raw_dist + 1) : 1;
                 size_t const length = (0x100 - ((raw_len & 0x7FU) << 1U))
                                       + ((raw_len & 0x80U) >> 7U);
-
-                for (size_t i = 0; i < length; i++) {
-                    size_t const Pointer = Dst.tellp();
-                    Dst.seekg(Pointer - distance);
-                    uint16_t const Word = BigEndian::Read2(Dst);
-                    Dst.seekp(Pointer);
-                    BigEndian::Write2(Dst, Word);
+                if (2 * distance > Dst.size()) {
+                    // Corrupt data: the match starts before the output.
+                    break;
                 }
+
+                copy_match_words(Dst, distance, length);
             }
         }
+        return src.tell();
     }
 
-    static void encode(ostream& Dst, uint8_t const* Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const* Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType    = typename ComperXAdaptor::EdgeType;
         using CompOStream = LZSSOStream<ComperXAdaptor>;
 
         // Compute optimal Comper parsing of input file.
-        auto list = find_optimal_lzss_parse(Data, Size, ComperXAdaptor{});
-        CompOStream out(Dst);
+        auto const& list = find_optimal_lzss_parse(
+                Data, Size, ComperXAdaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        CompOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -202,16 +209,36 @@ class comperx_internal {
 };
 
 bool comperx::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    comperx_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = comperx_internal::decode(
+            in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool comperx::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
-    comperx_internal::encode(Dst, data, Size);
+size_t comperx::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return comperx_internal::decode(data, Size, Dst);
+}
+
+bool comperx::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
+    comperx_internal::encode(
+            Dst, data, Size, effort, numthreads, matchfinder, workspace);
     return true;
 }
+
+bool comperx::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, effort, 1, matchfinder);
+}
@@ -23,9 +23,7 @@
 #include <iostream>
 #include <istream>
 #include <limits>
-#include <map>
 #include <ostream>
-#include <set>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -40,6 +38,7 @@
 #include <mdcomp/bitstream.hh>
 #include <mdcomp/enigma.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
+#include <mdcomp/parallel.hh>
 
 using std::array;
 using std::forward;
@@ -48,15 +47,12 @@ using std::iostream;
 using std::istream;
 using std::make_index_sequence;
 using std::make_signed_t;
-using std::map;
 using std::ostream;
-using std::pair;
-using std::set;
 using std::streamsize;
 using std::stringstream;
 using std::vector;
 
-using EniIBitstream = ibitstream<uint16_t, true>;
+using EniIBitstream = ibitbuffer<uint16_t, true>;
 using EniOBitstream = obitstream<uint16_t>;
 
 template <typename Callback>
@@ -76,32 +72,8 @@ class base_flag_io {
     Callback_t* callback;
 };
 
-using flag_reader = base_flag_io<uint16_t(EniIBitstream&)>;
 using flag_writer = base_flag_io<void(EniOBitstream&, uint16_t)>;
 
-template <size_t N, size_t I>
-struct read_bitfield_helper {
-    uint16_t operator()(EniIBitstream& bits, uint16_t flags) const {
-        if ((N & (1U << (I - 1))) != 0) {
-            flags |= uint16_t(bits.pop() << (I + 10U));
-        }
-        return read_bitfield_helper<N, I - 1>{}(bits, flags);
-    }
-};
-
-template <size_t N>
-struct read_bitfield_helper<N, 0> {
-    uint16_t operator()(EniIBitstream& bits, uint16_t flags) const {
-        ignore_unused_variable_warning(bits, flags);
-        return flags;
-    }
-};
-
-template <size_t N>
-uint16_t read_bitfield(EniIBitstream& bits) {
-    return read_bitfield_helper<N, 5>{}(bits, 0);
-}
-
 template <size_t N, size_t I>
 struct write_bitfield_helper {
     void operator()(EniOBitstream& bits, uint16_t const flags) const {
@@ -124,11 +96,6 @@ void write_bitfield(EniOBitstream& bits, uint16_t const flags) {
     write_bitfield_helper<N, 5>{}(bits, flags);
 }
 
-template <std::size_t... I>
-constexpr auto createMaskArray(flag_reader::tag, std::index_sequence<I...>) {
-    return array<flag_reader, sizeof...(I)>{flag_reader(read_bitfield<I>)...};
-}
-
 template <std::size_t... I>
 constexpr auto createMaskArray(flag_writer::tag, std::index_sequence<I...>) {
     return array<flag_writer, sizeof...(I)>{flag_writer(write_bitfield<I>)...};
@@ -141,6 +108,49 @@ const base_flag_io<Callback>& base_flag_io<Callback>::get(size_t const n) {
     return Array[n];
 }
 
+// Reads the flags and tile number of a tile at once: the flags selected by
+// the mask come first, highest first, followed by the low bits of the tile
+// number. A table then puts the flags in place.
+class tile_reader {
+public:
+    tile_reader(size_t const mask, size_t const packet_length) noexcept
+            : value_bits(packet_length),
+              value_mask(packet_length >= 16
+                                 ? 0xffffU
+                                 : uint16_t((1U << packet_length) - 1U)) {
+        size_t numflags = 0;
+        for (size_t bit = 0; bit < 5; bit++) {
+            numflags += (mask >> bit) & 1U;
+        }
+        width = numflags + value_bits;
+        for (size_t ii = 0; ii < (size_t(1) << numflags); ii++) {
+            uint16_t flags = 0;
+            size_t   next  = numflags;
+            for (size_t bit = 5; bit-- > 0;) {
+                if (((mask >> bit) & 1U) != 0 && ((ii >> --next) & 1U) != 0) {
+                    flags |= uint16_t(1U << (bit + 11U));
+                }
+            }
+            flag_table[ii] = flags;
+        }
+    }
+    // Only corrupt data has tiles too wide to read at once.
+    bool valid() const noexcept {
+        return width <= EniIBitstream::MaxPeekBits;
+    }
+    uint16_t operator()(EniIBitstream& bits) const noexcept {
+        uint64_t const field = bits.peek(width);
+        bits.consume(width);
+        return flag_table[field >> value_bits] | uint16_t(field & value_mask);
+    }
+
+private:
+    std::array<uint16_t, 32> flag_table{};
+    size_t                   width{0};
+    size_t                   value_bits;
+    uint16_t                 value_mask;
+};
+
 // Blazing fast function that gives the index of the MSB.
 int slog2(unsigned val) {
 #ifdef __GNUG__
@@ -170,76 +180,533 @@ int slog2(unsigned val) {
 #endif
 }
 
-// Comparison functor, see below.
-struct Compare_count {
-    bool operator()(
-            pair<uint16_t const, size_t>& it1,
-            pair<uint16_t const, size_t>& it2) {
-        return (it1.second < it2.second);
+class enigma_internal {
+    // Number of distinct 2-byte values.
+    constexpr static size_t const NumWords = size_t(1) << 16U;
+    // Packets with a 4-bit count hold up to 16 words, except for copied
+    // words: a count of $F there marks the end of the file.
+    constexpr static size_t const MaxCount     = 16;
+    constexpr static size_t const MaxCopyCount = 15;
+    // How many of the best incrementing and common values the extended
+    // search tries.
+    constexpr static size_t const NumCandidates = 4;
+
+    // The encoding parameters in the file header.
+    struct Header {
+        uint16_t packet_length;
+        uint16_t mask;    // Flags stored with each tile, shifted down 11 bits.
+        uint16_t incrementing_value;
+        uint16_t common_value;
+        // Makes the header with the smallest tiles that can store the words
+        // that were ORed into maskval.
+        static Header for_words(
+                uint16_t const maskval, uint16_t const incrementing_value,
+                uint16_t const common_value) noexcept {
+            uint16_t const low = maskval & 0x7ffU;
+            return Header{
+                    uint16_t(low == 0 ? 1 : slog2(low) + 1),
+                    uint16_t(maskval >> 11U), incrementing_value,
+                    common_value};
+        }
+        // Number of bits each stored tile takes.
+        size_t tile_bits() const noexcept {
+            size_t bits = packet_length;
+            for (size_t bit = 0; bit < 5; bit++) {
+                bits += (mask >> bit) & 1U;
+            }
+            return bits;
+        }
+        // Whether the word can be stored as a tile.
+        bool storable(uint16_t const v) const noexcept {
+            uint16_t const kept = uint16_t(mask << 11U)
+                                  | uint16_t((1U << packet_length) - 1U);
+            return (v & ~kept) == 0;
+        }
+    };
+
+    enum class PacketType : uint8_t { incrementing, common, delta, copy };
+    struct Packet {
+        PacketType type;
+        // For delta packets: 0, 1 or 2 for steps of 0, 1 or -1.
+        uint8_t mode;
+        // Number of words in the packet.
+        uint8_t count;
+    };
+
+    // Number of bits a packet takes in the file.
+    static size_t packet_bits(
+            Packet const& packet, size_t const tile_bits) noexcept {
+        switch (packet.type) {
+        case PacketType::incrementing:
+        case PacketType::common:
+            return 6;
+        case PacketType::delta:
+            return 7 + tile_bits;
+        case PacketType::copy:
+            return 7 + packet.count * tile_bits;
+        }
+        __builtin_unreachable();
     }
-};
 
-// This flushes (if needed) the contents of the inlined data buffer.
-static inline void flush_buffer(
-        vector<uint16_t>& buf, EniOBitstream& bits, flag_writer& putMask,
-        uint16_t const packet_length) {
-    if (buf.empty()) {
-        return;
+    // For each 2-byte value, finds the length of the incrementing (not
+    // necessarily contiguous) run that starts with it: the run takes the
+    // first occurrence of the value, then the next occurrence of the value
+    // plus one, and so on. The original algorithm does this for all 65536
+    // 2-byte words, while this version only checks the 2-byte words actually
+    // in the file.
+    //
+    // All runs are followed in a single pass over the file. Runs waiting for
+    // the same value will grow together from then on, so they are merged
+    // into a group; only the first run of each group keeps count of how
+    // much the group grew, and the others keep how much longer they are
+    // than the run they were merged into.
+    static vector<size_t> incrementing_run_lengths(
+            vector<uint16_t> const& unpack, vector<size_t> const& counts) {
+        constexpr static uint32_t const NoGroup = NumWords;
+        // Group waiting for each value, by its first run.
+        vector<uint32_t> waiting(NumWords, NoGroup);
+        // Length of each run, as described above.
+        vector<size_t> lengths(NumWords, 0);
+        // The run each run was merged into, and the merge order.
+        vector<uint16_t> parent(NumWords, 0);
+        vector<uint16_t> merged;
+        for (size_t v = 0; v < NumWords; v++) {
+            if (counts[v] != 0) {
+                waiting[v] = uint32_t(v);
+            }
+        }
+        for (auto const elem : unpack) {
+            uint32_t const group = waiting[elem];
+            if (group == NoGroup) {
+                continue;
+            }
+            uint16_t const next = elem + 1;
+            waiting[elem]       = NoGroup;
+            lengths[group] += 1;
+            uint32_t const other = waiting[next];
+            if (other == NoGroup) {
+                waiting[next] = group;
+            } else {
+                // Unsigned wraparound is fine here: it is undone below.
+                lengths[group] -= lengths[other];
+                parent[group] = uint16_t(other);
+                merged.push_back(uint16_t(group));
+            }
+        }
+        // A run can only be merged into another while that one is still the
+        // first of its group, so going backwards gives each run its final
+        // length before the runs merged into it need it.
+        for (auto it = merged.crbegin(); it != merged.crend(); ++it) {
+            lengths[*it] += lengths[parent[*it]];
+        }
+        return lengths;
     }
 
-    bits.write(0x70U | ((buf.size() - 1) & 0xfU), 7);
-    for (const auto v : buf) {
-        putMask(bits, v);
-        bits.write(v & 0x7ffU, packet_length);
+    // Finds up to count of the values in the file with the highest scores,
+    // best first; ties go to the lowest value.
+    static vector<uint16_t> top_values(
+            vector<size_t> const& scores, vector<size_t> const& counts,
+            size_t const count) {
+        vector<uint16_t> values;
+        for (size_t v = 0; v < NumWords; v++) {
+            if (counts[v] != 0) {
+                values.push_back(uint16_t(v));
+            }
+        }
+        if (values.empty()) {
+            // Empty file: any value will do.
+            values.push_back(0);
+        }
+        auto const middle = values.begin() + std::min(count, values.size());
+        std::partial_sort(
+                values.begin(), middle, values.end(),
+                [&](uint16_t const lhs, uint16_t const rhs) {
+                    return scores[lhs] > scores[rhs]
+                           || (scores[lhs] == scores[rhs] && lhs < rhs);
+                });
+        values.erase(middle, values.end());
+        return values;
+    }
+
+    // Marks the words that are equal to the incrementing value when they are
+    // reached. The encoder always puts these in incrementing packets, so
+    // which words they are does not depend on the rest of the encoding.
+    static vector<bool> incrementing_words(
+            vector<uint16_t> const& unpack, uint16_t next_value) {
+        vector<bool> incrementing(unpack.size(), false);
+        for (size_t i = 0; i < unpack.size(); i++) {
+            if (unpack[i] == next_value) {
+                incrementing[i] = true;
+                next_value++;
+            }
+        }
+        return incrementing;
+    }
+
+    // Encodes the words in order, taking the first packet that fits each.
+    static vector<Packet> parse_greedy(
+            vector<uint16_t> const& unpack, Header const& header) {
+        constexpr const uint16_t minus_one
+                = std::numeric_limits<uint16_t>::max();
+        vector<Packet> packets;
+        size_t const   size               = unpack.size();
+        uint16_t       incrementing_value = header.incrementing_value;
+        uint16_t const common_value       = header.common_value;
+        // Words waiting to be copied.
+        size_t     buffered = 0;
+        auto const flush    = [&]() {
+            if (buffered != 0) {
+                packets.push_back(
+                        Packet{PacketType::copy, 0, uint8_t(buffered)});
+                buffered = 0;
+            }
+        };
+        size_t pos = 0;
+        while (pos < size) {
+            uint16_t const v = unpack[pos];
+            if (v == incrementing_value) {
+                flush();
+                uint16_t next = v + 1;
+                size_t   cnt  = 0;
+                for (size_t i = pos + 1; i < size && cnt < 0xf; i++) {
+                    if (next != unpack[i]) {
+                        break;
+                    }
+                    next++;
+                    cnt++;
+                }
+                packets.push_back(Packet{
+                        PacketType::incrementing, 0, uint8_t(cnt + 1)});
+                incrementing_value = next;
+                pos += cnt;
+            } else if (v == common_value) {
+                flush();
+                size_t cnt = 0;
+                for (size_t i = pos + 1; i < size && cnt < 0xf; i++) {
+                    if (v != unpack[i]) {
+                        break;
+                    }
+                    cnt++;
+                }
+                packets.push_back(
+                        Packet{PacketType::common, 0, uint8_t(cnt + 1)});
+                pos += cnt;
+            } else {
+                uint16_t next  = pos + 1 < size ? unpack[pos + 1] : v;
+                uint16_t delta = next - v;
+                if (pos + 1 < size && next != incrementing_value
+                    && (delta == minus_one || delta == 0 || delta == 1)) {
+                    flush();
+                    size_t cnt = 1;
+                    next += delta;
+                    for (size_t i = pos + 2; i < size && cnt < 0xf; i++) {
+                        if (next != unpack[i] || next == incrementing_value) {
+                            break;
+                        }
+                        next += delta;
+                        cnt++;
+                    }
+                    uint8_t const mode = delta == minus_one ? 2 : delta;
+                    packets.push_back(
+                            Packet{PacketType::delta, mode, uint8_t(cnt + 1)});
+                    pos += cnt;
+                } else {
+                    if (buffered >= 0xf) {
+                        flush();
+                    }
+                    buffered++;
+                }
+            }
+            pos++;
+        }
+        flush();
+        return packets;
     }
-    buf.clear();
-}
 
-template <>
-size_t moduled_enigma::PadMaskBits = 1U;
+    // Finds the packets that give the smallest file, by dynamic programming
+    // over the words. The words that get incrementing packets are known
+    // beforehand, so the position in the file is all the state there is. No
+    // packet holds more than 16 words, so this takes linear time.
+    static vector<Packet> parse_optimal(
+            vector<uint16_t> const& unpack, Header const& header) {
+        constexpr static std::array<uint16_t, 3> const modeDeltaLUT
+                = {0, 1, 0xffff};
+
+        // How many words from each position can go in each kind of packet.
+        struct RunLengths {
+            bool                   storable{false};
+            uint8_t                incrementing{0};
+            uint8_t                common{0};
+            uint8_t                copy{0};
+            std::array<uint8_t, 3> delta{};
+        };
+        size_t const       size = unpack.size();
+        vector<bool> const incrementing
+                = incrementing_words(unpack, header.incrementing_value);
+        vector<RunLengths> runs(size + 1);
+        auto const         extend = [](size_t const len, size_t const limit) {
+            return uint8_t(std::min(len + 1, limit));
+        };
+        for (size_t i = size; i-- > 0;) {
+            RunLengths&       here = runs[i];
+            RunLengths const& next = runs[i + 1];
+            if (incrementing[i]) {
+                here.incrementing = extend(next.incrementing, MaxCount);
+                continue;
+            }
+            // Only copied words and the first word of a delta packet are
+            // stored as tiles.
+            here.storable = header.storable(unpack[i]);
+            if (here.storable) {
+                here.copy = extend(next.copy, MaxCopyCount);
+            }
+            if (unpack[i] == header.common_value) {
+                here.common = extend(next.common, MaxCount);
+            }
+            for (size_t mode = 0; mode < modeDeltaLUT.size(); mode++) {
+                bool const follows
+                        = next.delta[mode] != 0
+                          && unpack[i + 1]
+                                     == uint16_t(
+                                             unpack[i] + modeDeltaLUT[mode]);
+                here.delta[mode]
+                        = follows ? extend(next.delta[mode], MaxCount) : 1;
+            }
+        }
+
+        // The cheapest way to encode the words before each position, by the
+        // last packet used.
+        struct Step {
+            size_t cost{std::numeric_limits<size_t>::max()};
+            Packet packet{PacketType::copy, 0, 0};
+        };
+        size_t const tile_bits = header.tile_bits();
+        vector<Step> best(1, Step{0, Packet{PacketType::copy, 0, 0}});
+        best.resize(size + 1);
+        for (size_t i = 0; i < size; i++) {
+            RunLengths const& here  = runs[i];
+            auto const        relax = [&](PacketType const type,
+                                   size_t const mode, size_t const count) {
+                Packet const packet{type, uint8_t(mode), uint8_t(count)};
+                size_t const cost
+                        = best[i].cost + packet_bits(packet, tile_bits);
+                Step& dest = best[i + count];
+                if (cost < dest.cost) {
+                    dest = Step{cost, packet};
+                }
+            };
+            for (size_t k = 1; k <= here.incrementing; k++) {
+                relax(PacketType::incrementing, 0, k);
+            }
+            for (size_t k = 1; k <= here.common; k++) {
+                relax(PacketType::common, 0, k);
+            }
+            // A single word is as cheap to copy as to put in a delta packet.
+            if (here.storable) {
+                for (size_t mode = 0; mode < modeDeltaLUT.size(); mode++) {
+                    for (size_t k = 2; k <= here.delta[mode]; k++) {
+                        relax(PacketType::delta, mode, k);
+                    }
+                }
+            }
+            for (size_t k = 1; k <= here.copy; k++) {
+                relax(PacketType::copy, 0, k);
+            }
+        }
+
+        // Go back through the packets, and put them in order.
+        vector<Packet> packets;
+        for (size_t end = size; end > 0; end -= best[end].packet.count) {
+            packets.push_back(best[end].packet);
+        }
+        std::reverse(packets.begin(), packets.end());
+        return packets;
+    }
+
+    static vector<Packet> find_packets(
+            vector<uint16_t> const& unpack, Header const& header,
+            EnigmaParse const parse) {
+        if (parse == EnigmaParse::optimal) {
+            return parse_optimal(unpack, header);
+        }
+        return parse_greedy(unpack, header);
+    }
+
+    // Picks the value that starts the longest incrementing run and the most
+    // common value, as the original compressor does.
+    static Header standard_header(
+            vector<uint16_t> const& unpack, vector<size_t> const& counts,
+            uint16_t const maskval) {
+        vector<size_t> const lengths = incrementing_run_lengths(unpack, counts);
+        uint16_t const incrementing_value
+                = top_values(lengths, counts, 1).front();
+        uint16_t const common_value = top_values(counts, counts, 1).front();
+        return Header::for_words(maskval, incrementing_value, common_value);
+    }
+
+    // Tries the best few incrementing and common values, each with a header
+    // for all words and one only for the words that are stored as tiles,
+    // and picks the one that gives the smallest file. Ties go to the header
+    // the standard search would pick.
+    static Header search_header(
+            vector<uint16_t> const& unpack, vector<size_t> const& counts,
+            uint16_t const maskval, EnigmaParse const parse) {
+        vector<uint16_t> const incrementing_values = top_values(
+                incrementing_run_lengths(unpack, counts), counts,
+                NumCandidates);
+        vector<uint16_t> const common_values
+                = top_values(counts, counts, NumCandidates);
+        struct Candidate {
+            Header header;
+            bool   stored_only;
+            size_t size;
+        };
+        vector<Candidate> candidates;
+        for (auto const incrementing_value : incrementing_values) {
+            for (auto const common_value : common_values) {
+                for (bool const stored_only : {false, true}) {
+                    candidates.push_back(Candidate{
+                            Header::for_words(
+                                    maskval, incrementing_value, common_value),
+                            stored_only, 0});
+                }
+            }
+        }
+
+        auto const evaluate = [&](Candidate& candidate) {
+            Header& header = candidate.header;
+            if (candidate.stored_only) {
+                // Words in incrementing and common packets need not fit.
+                vector<bool> const incrementing
+                        = incrementing_words(unpack, header.incrementing_value);
+                uint16_t stored = 0;
+                for (size_t i = 0; i < unpack.size(); i++) {
+                    if (!incrementing[i] && unpack[i] != header.common_value) {
+                        stored |= unpack[i];
+                    }
+                }
+                Header const full = header;
+                header            = Header::for_words(
+                        stored, header.incrementing_value,
+                        header.common_value);
+                if (header.packet_length == full.packet_length
+                    && header.mask == full.mask) {
+                    // Same as the previous candidate.
+                    candidate.size = std::numeric_limits<size_t>::max();
+                    return;
+                }
+            }
+            size_t const tile_bits = header.tile_bits();
+            candidate.size         = 0;
+            for (auto const& packet : find_packets(unpack, header, parse)) {
+                candidate.size += packet_bits(packet, tile_bits);
+            }
+        };
+        parallel_for(
+                candidates.size(), 1,
+                std::min(hardware_thread_count(), candidates.size()),
+                [&](size_t const first, size_t const last) {
+                    for (size_t ii = first; ii < last; ii++) {
+                        evaluate(candidates[ii]);
+                    }
+                });
+
+        auto const best = std::min_element(
+                candidates.cbegin(), candidates.cend(),
+                [](Candidate const& lhs, Candidate const& rhs) {
+                    return lhs.size < rhs.size;
+                });
+        return best->header;
+    }
+
+    static void write_packets(
+            EniOBitstream& bits, vector<uint16_t> const& unpack,
+            vector<Packet> const& packets, Header const& header) {
+        auto   putMask = flag_writer::get(header.mask);
+        size_t pos     = 0;
+        for (auto const& packet : packets) {
+            uint16_t const v = unpack[pos];
+            switch (packet.type) {
+            case PacketType::incrementing:
+                bits.write(0x00U | (packet.count - 1U), 6);
+                break;
+            case PacketType::common:
+                bits.write(0x10U | (packet.count - 1U), 6);
+                break;
+            case PacketType::delta:
+                bits.write(
+                        ((packet.mode | 4U) << 4U) | (packet.count - 1U), 7);
+                putMask(bits, v);
+                bits.write(v & 0x7ffU, header.packet_length);
+                break;
+            case PacketType::copy:
+                bits.write(0x70U | (packet.count - 1U), 7);
+                for (size_t i = pos; i < pos + packet.count; i++) {
+                    putMask(bits, unpack[i]);
+                    bits.write(unpack[i] & 0x7ffU, header.packet_length);
+                }
+                break;
+            }
+            pos += packet.count;
+        }
+    }
 
-class enigma_internal {
 public:
-    static void decode(std::istream& in, std::ostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst) {
+        constexpr static size_t const HeaderSize = 6;
+        if (Size < HeaderSize) {
+            return Size;
+        }
         // Read header.
-        size_t const packet_length      = Read1(in);
-        auto         getMask            = flag_reader::get(Read1(in));
-        size_t       incrementing_value = BigEndian::Read2(in);
-        size_t const common_value       = BigEndian::Read2(in);
+        uint8_t const*    in                 = Data;
+        size_t const      packet_length      = Read1(in);
+        tile_reader const getTile(Read1(in), packet_length);
+        uint16_t          incrementing_value = BigEndian::Read2(in);
+        uint16_t const    common_value       = BigEndian::Read2(in);
+        if (!getTile.valid()) {
+            return HeaderSize;
+        }
 
-        ibitstream<uint16_t, true>                bits(in);
-        constexpr static std::array<int, 3> const modeDeltaLUT = {0, 1, -1};
+        EniIBitstream bits(Data + HeaderSize, Size - HeaderSize);
+        constexpr static std::array<uint16_t, 3> const modeDeltaLUT
+                = {0, 1, 0xffff};
+
+        // Writes cnt words, starting at value and stepping by delta.
+        auto putRun = [&](uint16_t const value, uint16_t const delta,
+                          size_t const cnt) {
+            size_t const start = Dst.size();
+            Dst.resize(start + 2 * cnt);
+            uint8_t* const out = Dst.data() + start;
+            for (size_t i = 0; i < cnt; i++) {
+                uint16_t const outv = value + uint16_t(delta * i);
+                out[2 * i]          = uint8_t(outv >> 8U);
+                out[2 * i + 1]      = uint8_t(outv & 0xffU);
+            }
+        };
 
         // Lets put in a safe termination condition here.
-        while (in.good()) {
+        while (bits.good()) {
             if (bits.pop() != 0U) {
                 size_t const mode = bits.read(2);
                 switch (mode) {
                 case 2:
                 case 1:
                 case 0: {
-                    size_t const   cnt   = bits.read(4) + 1;
-                    uint16_t const flags = getMask(bits);
-                    uint16_t       outv  = bits.read(packet_length);
-                    outv |= flags;
-
-                    for (size_t i = 0; i < cnt; i++) {
-                        BigEndian::Write2(Dst, outv);
-                        outv += modeDeltaLUT[mode];
-                    }
+                    size_t const   cnt  = bits.read(4) + 1;
+                    uint16_t const outv = getTile(bits);
+                    putRun(outv, modeDeltaLUT[mode], cnt);
                     break;
                 }
                 case 3: {
                     size_t const cnt = bits.read(4);
                     // This marks decompression as being done.
                     if (cnt == 0x0F) {
-                        return;
+                        return HeaderSize + bits.tell();
                     }
 
                     for (size_t i = 0; i <= cnt; i++) {
-                        uint16_t flags = getMask(bits);
-                        uint16_t outv  = bits.read(packet_length);
-                        BigEndian::Write2(Dst, outv | flags);
+                        BigEndian::Write2(Dst, getTile(bits));
                     }
                     break;
                 }
@@ -247,31 +714,29 @@ class enigma_internal {
                     __builtin_unreachable();
                 }
             } else {
-                if (bits.pop() == 0U) {
-                    size_t const cnt = bits.read(4) + 1;
-                    for (size_t i = 0; i < cnt; i++) {
-                        BigEndian::Write2(Dst, incrementing_value++);
-                    }
+                // One bit selects the incrementing or the common value, and
+                // is followed by the 4-bit count; both are read at once.
+                size_t const cnt = bits.read(5) + 1;
+                if (cnt <= 0x10) {
+                    putRun(incrementing_value, 1, cnt);
+                    incrementing_value += uint16_t(cnt);
                 } else {
-                    size_t const cnt = bits.read(4) + 1;
-                    for (size_t i = 0; i < cnt; i++) {
-                        BigEndian::Write2(Dst, common_value);
-                    }
+                    putRun(common_value, 0, cnt - 0x10);
                 }
             }
         }
+        return HeaderSize + bits.tell();
     }
 
-    static void encode(std::istream& Src, std::ostream& Dst) {
+    static void encode(
+            std::istream& Src, std::ostream& Dst, EnigmaParse const parse,
+            EnigmaSearch const search) {
         // To unpack source into 2-byte words.
         vector<uint16_t> unpack;
-        // Frequency map.
-        map<uint16_t, size_t> counts;
-        // Presence map.
-        set<uint16_t> elems;
+        // Frequency table, for all 2-byte values.
+        vector<size_t> counts(NumWords, 0);
 
-        // Unpack source into array. Along the way, build frequency and presence
-        // maps.
+        // Unpack source into array. Along the way, build frequency table.
         uint16_t maskval = 0;
         Src.clear();
         Src.seekg(0);
@@ -282,121 +747,24 @@ class enigma_internal {
             }
             maskval |= v;
             counts[v] += 1;
-            elems.insert(v);
             unpack.push_back(v);
         }
 
-        auto           putMask       = flag_writer::get(maskval >> 11U);
-        uint16_t const packet_length = slog2(maskval & 0x7ffU) + 1;
-
-        // Find the most common 2-byte value.
-        Compare_count  cmp;
-        auto           high = max_element(counts.begin(), counts.end(), cmp);
-        uint16_t const common_value = high->first;
-        // No longer needed.
-        counts.clear();
-
-        // Find incrementing (not necessarily contiguous) runs.
-        // The original algorithm does this for all 65536 2-byte words, while
-        // this version only checks the 2-byte words actually in the file.
-        map<uint16_t, size_t> runs;
-        for (auto next : elems) {
-            auto val = runs.emplace(next, 0).first;
-            for (auto& elem : unpack) {
-                if (elem == next) {
-                    next++;
-                    val->second += 1;
-                }
-            }
-        }
-        // No longer needed.
-        elems.clear();
-
-        // Find the starting 2-byte value with the longest incrementing run.
-        auto     incr = max_element(runs.begin(), runs.end(), cmp);
-        uint16_t incrementing_value = incr->first;
-        // No longer needed.
-        runs.clear();
+        Header const header
+                = search == EnigmaSearch::extended
+                          ? search_header(unpack, counts, maskval, parse)
+                          : standard_header(unpack, counts, maskval);
 
         // Output header.
-        Write1(Dst, packet_length);
-        Write1(Dst, maskval >> 11U);
-        BigEndian::Write2(Dst, incrementing_value);
-        BigEndian::Write2(Dst, common_value);
+        Write1(Dst, header.packet_length);
+        Write1(Dst, header.mask);
+        BigEndian::Write2(Dst, header.incrementing_value);
+        BigEndian::Write2(Dst, header.common_value);
 
         // Time now to compress the file.
-        EniOBitstream    bits(Dst);
-        vector<uint16_t> buf;
-        size_t           pos = 0;
-        while (pos < unpack.size()) {
-            uint16_t const v = unpack[pos];
-            if (v == incrementing_value) {
-                flush_buffer(buf, bits, putMask, packet_length);
-                uint16_t next = v + 1;
-                size_t   cnt  = 0;
-                for (size_t i = pos + 1; i < unpack.size() && cnt < 0xf; i++) {
-                    if (next != unpack[i]) {
-                        break;
-                    }
-                    next++;
-                    cnt++;
-                }
-                bits.write(0x00U | cnt, 6);
-                incrementing_value = next;
-                pos += cnt;
-            } else if (v == common_value) {
-                flush_buffer(buf, bits, putMask, packet_length);
-                uint16_t next = v;
-                size_t   cnt  = 0;
-                for (size_t i = pos + 1; i < unpack.size() && cnt < 0xf; i++) {
-                    if (next != unpack[i]) {
-                        break;
-                    }
-                    cnt++;
-                }
-                bits.write(0x10U | cnt, 6);
-                pos += cnt;
-            } else {
-                uint16_t next  = unpack[pos + 1];
-                uint16_t delta = next - v;
-
-                constexpr const uint16_t minus_one
-                        = std::numeric_limits<uint16_t>::max();
-                if (pos + 1 < unpack.size() && next != incrementing_value
-                    && (delta == minus_one || delta == 0 || delta == 1)) {
-                    flush_buffer(buf, bits, putMask, packet_length);
-                    size_t cnt = 1;
-                    next += delta;
-                    for (size_t i = pos + 2; i < unpack.size() && cnt < 0xf;
-                         i++) {
-                        if (next != unpack[i] || next == incrementing_value) {
-                            break;
-                        }
-                        next += delta;
-                        cnt++;
-                    }
-
-                    if (delta == minus_one) {
-                        delta = 2;
-                    }
-
-                    delta = ((delta | 4U) << 4U);
-                    bits.write(delta | cnt, 7);
-                    putMask(bits, v);
-                    bits.write(v & 0x7ffU, packet_length);
-                    pos += cnt;
-                } else {
-                    if (buf.size() >= 0xf) {
-                        flush_buffer(buf, bits, putMask, packet_length);
-                    }
-
-                    buf.push_back(v);
-                }
-            }
-            pos++;
-        }
-
-        flush_buffer(buf, bits, putMask, packet_length);
+        EniOBitstream bits(Dst);
+        write_packets(
+                bits, unpack, find_packets(unpack, header, parse), header);
 
         // Terminator.
         bits.write(0x7f, 7);
@@ -405,23 +773,35 @@ class enigma_internal {
 };
 
 bool enigma::decode(istream& Src, ostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    enigma_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = enigma_internal::decode(
+            in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool enigma::encode(istream& Src, ostream& Dst) {
-    enigma_internal::encode(Src, Dst);
+size_t enigma::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return enigma_internal::decode(data, Size, Dst);
+}
+
+bool enigma::encode(
+        istream& Src, ostream& Dst, EnigmaParse const parse,
+        EnigmaSearch const search) {
+    enigma_internal::encode(Src, Dst, parse, search);
     return true;
 }
 
-bool enigma::encode(std::ostream& Dst, uint8_t const* data, size_t const Size) {
+bool enigma::encode(
+        std::ostream& Dst, uint8_t const* data, size_t const Size,
+        EnigmaParse const parse, EnigmaSearch const search) {
     stringstream Src(ios::in | ios::out | ios::binary);
     Src.write(reinterpret_cast<char const*>(data), Size);
     Src.seekg(0);
-    return encode(Src, Dst);
+    return encode(Src, Dst, parse, search);
 }
@@ -21,25 +21,22 @@
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/kosinski.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 
 #include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <vector>
 
 using std::array;
-using std::ios;
 using std::iostream;
 using std::istream;
 using std::make_signed_t;
 using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
-using std::stringstream;
-
-template <>
-size_t moduled_kosinski::PadMaskBits = 1U;
+using std::vector;
 
 class kosinski_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -72,6 +69,9 @@ class kosinski_internal {
         constexpr static bool const DescriptorLittleEndianBits = true;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 8192;
         // Size of the look-ahead buffer.
@@ -141,24 +141,25 @@ class kosinski_internal {
             // Do normal matches.
             return false;
         }
-        // KosinskiM needs to pad each module to a multiple of 16 bytes.
-        static size_t get_padding(size_t const totallen) noexcept {
-            return ((totallen + moduled_kosinski::PadMaskBits)
-                    & ~moduled_kosinski::PadMaskBits)
-                   - totallen;
+        // Mask of the bits of the compressed size that must be zero once it
+        // is padded. KosinskiM pads each module to a multiple of 16 bytes.
+        size_t PadMaskBits;
+        size_t get_padding(size_t const totallen) const noexcept {
+            return ((totallen + PadMaskBits) & ~PadMaskBits) - totallen;
         }
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst) {
         using KosIStream = LZSSIStream<KosinskiAdaptor>;
 
-        KosIStream src(in);
+        KosIStream src(Data, Size);
 
-        while (in.good()) {
+        while (src.good()) {
             if (src.descbit() != 0U) {
                 // Symbolwise match.
-                Write1(Dst, src.getbyte());
+                Dst.push_back(src.getbyte());
             } else {
                 // Dictionary matches.
                 // Count and distance
@@ -198,24 +199,29 @@ class kosinski_internal {
                     distance = 0x100U - src.getbyte();
                 }
 
-                for (size_t i = 0; i < Count; i++) {
-                    size_t Pointer = Dst.tellp();
-                    Dst.seekg(Pointer - distance);
-                    uint8_t Byte = Read1(Dst);
-                    Dst.seekp(Pointer);
-                    Write1(Dst, Byte);
+                if (distance > Dst.size()) {
+                    // Corrupt data: the match starts before the output.
+                    break;
                 }
+                copy_match(Dst, distance, Count);
             }
         }
+        return src.tell();
     }
 
-    static void encode(ostream& Dst, uint8_t const* Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const* Data, size_t const Size,
+            size_t const PadMaskBits, LZSSEffort const effort,
+            size_t const numthreads, MatchFinder const matchfinder,
+            LZSSWorkspace& workspace) {
         using EdgeType   = typename KosinskiAdaptor::EdgeType;
         using KosOStream = LZSSOStream<KosinskiAdaptor>;
 
         // Compute optimal Kosinski parsing of input file.
-        auto list = find_optimal_lzss_parse(Data, Size, KosinskiAdaptor{});
-        KosOStream out(Dst);
+        auto const& list = find_optimal_lzss_parse(
+                Data, Size, KosinskiAdaptor{PadMaskBits}, workspace, effort,
+                numthreads, matchfinder);
+        KosOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -272,16 +278,38 @@ class kosinski_internal {
 };
 
 bool kosinski::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    kosinski_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = kosinski_internal::decode(
+            in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
+    return true;
+}
+
+size_t kosinski::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return kosinski_internal::decode(data, Size, Dst);
+}
+
+bool kosinski::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
+    kosinski_internal::encode(
+            Dst, data, Size, 1U, effort, numthreads, matchfinder, workspace);
     return true;
 }
 
-bool kosinski::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
-    kosinski_internal::encode(Dst, data, Size);
+bool kosinski::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    kosinski_internal::encode(
+            Dst, data, Size, PadMaskBits, effort, 1, matchfinder,
+            LZSSWorkspace::thread_default());
     return true;
 }
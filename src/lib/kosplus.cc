@@ -21,25 +21,22 @@
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/kosplus.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 
 #include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <vector>
 
 using std::array;
-using std::ios;
 using std::iostream;
 using std::istream;
 using std::make_signed_t;
 using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
-using std::stringstream;
-
-template <>
-size_t moduled_kosplus::PadMaskBits = 1U;
+using std::vector;
 
 class kosplus_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -72,6 +69,9 @@ class kosplus_internal {
         constexpr static bool const DescriptorLittleEndianBits = false;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 8192;
         // Size of the look-ahead buffer.
@@ -149,15 +149,16 @@ class kosplus_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst) {
         using KosIStream = LZSSIStream<KosPlusAdaptor>;
 
-        KosIStream src(in);
+        KosIStream src(Data, Size);
 
-        while (in.good()) {
+        while (src.good()) {
             if (src.descbit() != 0U) {
                 // Symbolwise match.
-                Write1(Dst, src.getbyte());
+                Dst.push_back(src.getbyte());
             } else {
                 // Dictionary matches.
                 // Count and distance
@@ -194,24 +195,28 @@ class kosplus_internal {
                     Count = ((High << 1U) | Low) + 2;
                 }
 
-                for (size_t i = 0; i < Count; i++) {
-                    size_t Pointer = Dst.tellp();
-                    Dst.seekg(Pointer - distance);
-                    uint8_t Byte = Read1(Dst);
-                    Dst.seekp(Pointer);
-                    Write1(Dst, Byte);
+                if (distance > Dst.size()) {
+                    // Corrupt data: the match starts before the output.
+                    break;
                 }
+                copy_match(Dst, distance, Count);
             }
         }
+        return src.tell();
     }
 
-    static void encode(ostream& Dst, uint8_t const*& Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const*& Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType   = typename KosPlusAdaptor::EdgeType;
         using KosOStream = LZSSOStream<KosPlusAdaptor>;
 
         // Compute optimal KosPlus parsing of input file.
-        auto       list = find_optimal_lzss_parse(Data, Size, KosPlusAdaptor{});
-        KosOStream out(Dst);
+        auto const& list = find_optimal_lzss_parse(
+                Data, Size, KosPlusAdaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        KosOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -268,16 +273,36 @@ class kosplus_internal {
 };
 
 bool kosplus::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    kosplus_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = kosplus_internal::decode(
+            in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool kosplus::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
-    kosplus_internal::encode(Dst, data, Size);
+size_t kosplus::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return kosplus_internal::decode(data, Size, Dst);
+}
+
+bool kosplus::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
+    kosplus_internal::encode(
+            Dst, data, Size, effort, numthreads, matchfinder, workspace);
     return true;
 }
+
+bool kosplus::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, effort, 1, matchfinder);
+}
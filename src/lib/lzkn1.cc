@@ -21,25 +21,22 @@
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/lzkn1.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 
 #include <cstdint>
 #include <iostream>
 #include <istream>
 #include <ostream>
-#include <sstream>
+#include <vector>
 
 using std::array;
-using std::ios;
 using std::iostream;
 using std::istream;
 using std::make_signed_t;
 using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
-using std::stringstream;
-
-template <>
-size_t moduled_lzkn1::PadMaskBits = 1U;
+using std::vector;
 
 class lzkn1_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -71,6 +68,9 @@ class lzkn1_internal {
         constexpr static bool const DescriptorLittleEndianBits = true;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 1023;
         // Size of the look-ahead buffer.
@@ -141,22 +141,28 @@ class lzkn1_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Input, size_t const InputSize,
+            vector<uint8_t>& Dst) {
         using Lzkn1IStream = LZSSIStream<Lzkn1Adaptor>;
 
-        size_t const UncompressedSize = BigEndian::Read2(in);
+        if (InputSize < 2) {
+            return InputSize;
+        }
+        uint8_t const* header           = Input;
+        size_t const   UncompressedSize = BigEndian::Read2(header);
 
-        Lzkn1IStream           src(in);
+        Lzkn1IStream           src(Input + 2, InputSize - 2);
         constexpr size_t const eof_marker               = 0x1FU;
         constexpr size_t const packed_symbolwise_marker = 0xC0U;
         constexpr size_t const short_match_marker       = 0x80U;
 
         size_t BytesWritten = 0U;
 
-        while (in.good()) {
+        while (src.good()) {
             if (src.descbit() == 0U) {
                 // Symbolwise match.
-                Write1(Dst, src.getbyte());
+                Dst.push_back(src.getbyte());
                 BytesWritten++;
             } else {
                 // Dictionary matches or packed symbolwise match.
@@ -170,7 +176,7 @@ class lzkn1_internal {
                     // Packed symbolwise.
                     size_t const Count = Data - packed_symbolwise_marker + 8U;
                     for (size_t i = 0; i < Count; i++) {
-                        Write1(Dst, src.getbyte());
+                        Dst.push_back(src.getbyte());
                     }
                     BytesWritten += Count;
                 } else {
@@ -193,13 +199,11 @@ class lzkn1_internal {
                         Count    = (Data >> 4U) - 6U;
                     }
 
-                    for (size_t i = 0; i < Count; i++) {
-                        size_t Pointer = Dst.tellp();
-                        Dst.seekg(Pointer - distance);
-                        uint8_t Byte = Read1(Dst);
-                        Dst.seekp(Pointer);
-                        Write1(Dst, Byte);
+                    if (distance == 0 || distance > Dst.size()) {
+                        // Corrupt data: the match is not in the output.
+                        break;
                     }
+                    copy_match(Dst, distance, Count);
                     BytesWritten += Count;
                 }
             }
@@ -209,17 +213,23 @@ class lzkn1_internal {
                       << " bytes, got " << BytesWritten << " bytes instead."
                       << std::endl;
         }
+        return src.tell() + 2;
     }
 
-    static void encode(ostream& Dst, uint8_t const* Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const* Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType     = typename Lzkn1Adaptor::EdgeType;
         using Lzkn1OStream = LZSSOStream<Lzkn1Adaptor>;
 
         BigEndian::Write2(Dst, Size);
 
         // Compute optimal lzkn1 parsing of input file.
-        auto         list = find_optimal_lzss_parse(Data, Size, Lzkn1Adaptor{});
-        Lzkn1OStream out(Dst);
+        auto const&   list = find_optimal_lzss_parse(
+                Data, Size, Lzkn1Adaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        Lzkn1OStream out(Dst, workspace);
         constexpr size_t const eof_marker               = 0x1FU;
         constexpr size_t const packed_symbolwise_marker = 0xC0U;
 
@@ -277,16 +287,36 @@ class lzkn1_internal {
 };
 
 bool lzkn1::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    lzkn1_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed
+            = lzkn1_internal::decode(in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool lzkn1::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
-    lzkn1_internal::encode(Dst, data, Size);
+size_t lzkn1::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return lzkn1_internal::decode(data, Size, Dst);
+}
+
+bool lzkn1::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
+    lzkn1_internal::encode(
+            Dst, data, Size, effort, numthreads, matchfinder, workspace);
     return true;
 }
+
+bool lzkn1::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, effort, 1, matchfinder);
+}
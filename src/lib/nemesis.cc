@@ -21,37 +21,28 @@
 #include <mdcomp/bitstream.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/nemesis.hh>
+#include <mdcomp/parallel.hh>
 
 #include <algorithm>
 #include <array>
 #include <cstdint>
+#include <cstring>
 #include <istream>
+#include <limits>
 #include <map>
-#include <memory>
 #include <ostream>
-#include <queue>
-#include <set>
-#include <sstream>
-#include <string>
 #include <utility>
 #include <vector>
 
-using std::enable_shared_from_this;
-using std::fill_n;
-using std::ios;
-using std::iostream;
+#if defined(__SSE2__) || defined(_M_X64)
+#    include <emmintrin.h>
+#endif
+
 using std::istream;
-using std::make_shared;
 using std::map;
-using std::multiset;
 using std::numeric_limits;
 using std::ostream;
-using std::ostreambuf_iterator;
-using std::priority_queue;
-using std::shared_ptr;
 using std::streamsize;
-using std::string;
-using std::stringstream;
 using std::vector;
 
 // This represents a nibble run of up to 7 repetitions of the starting nibble.
@@ -79,6 +70,17 @@ class nibble_run {
     bool operator!=(nibble_run const& other) const noexcept {
         return !(*this == other);
     }
+    // Number of nibble runs the encoder can use: 16 nibbles, each repeated up
+    // to 7 times.
+    constexpr static size_t const NumRuns = 16 * 8;
+    // Position of the nibble run in the encoder's tables; this sorts in the
+    // same order as the nibble runs themselves.
+    size_t index() const noexcept {
+        return (size_t(nibble) << 3U) | count;
+    }
+    static nibble_run from_index(size_t const idx) noexcept {
+        return nibble_run(uint8_t(idx >> 3U), uint8_t(idx & 7U));
+    }
     // Getters/setters for all properties.
     uint8_t get_nibble() const noexcept {
         return nibble;
@@ -105,8 +107,8 @@ struct SizeFreqNibble {
 };
 
 struct Code {
-    size_t  code;
-    uint8_t len;
+    size_t  code{0};
+    uint8_t len{0};
     bool    operator<(Code const& rhs) const noexcept {
         return code < rhs.code || (code == rhs.code && len < rhs.len);
     }
@@ -114,32 +116,70 @@ struct Code {
     Code() noexcept = default;
 };
 
-using CodeSizeMap   = map<nibble_run, uint8_t>;
-using RunCountMap   = map<nibble_run, size_t>;
-using NibbleCodeMap = map<nibble_run, Code>;
+using CodeSizeTable = std::array<uint8_t, nibble_run::NumRuns>;
+using RunCountTable = std::array<size_t, nibble_run::NumRuns>;
 using CodeNibbleMap = map<Code, nibble_run>;
 
+// This associates each nibble run with its code, if it has one.
+class NibbleCodeTable {
+private:
+    std::array<Code, nibble_run::NumRuns> codes{};
+    size_t                                numcodes{0};
+
+public:
+    bool empty() const noexcept {
+        return numcodes == 0;
+    }
+    bool has_code(nibble_run const& run) const noexcept {
+        return codes[run.index()].len != 0;
+    }
+    Code const& operator[](nibble_run const& run) const noexcept {
+        return codes[run.index()];
+    }
+    void set(nibble_run const& run, Code const& code) noexcept {
+        if (!has_code(run)) {
+            numcodes++;
+        }
+        codes[run.index()] = code;
+    }
+    void clear() noexcept {
+        codes.fill(Code{});
+        numcodes = 0;
+    }
+};
+
+// Entry of the table used by the decoder to find the code at the start of the
+// next 8 bits of input, and what it stands for.
+struct CodeTableEntry {
+    uint8_t    len{0};           // Code length; 0 if no code fits in 8 bits.
+    bool       inline_rle{false};    // Code for an inline nibble run.
+    nibble_run run;                  // Nibble run for the code.
+};
+
+using CodeTable = std::array<CodeTableEntry, 256>;
+
 // Slightly based on code by Mark Nelson for Huffman encoding.
 // http://marknelson.us/1996/01/01/priority-queues/
-// This represents a node (leaf or branch) in the Huffman encoding tree.
-class node : public enable_shared_from_this<node> {
+// This represents a node (leaf or branch) in the Huffman encoding tree. All
+// nodes live in a NodePool, and branches refer to their children by their
+// position in it.
+class node {
+public:
+    constexpr static uint32_t const NoChild
+            = std::numeric_limits<uint32_t>::max();
+
 private:
-    shared_ptr<node> child0, child1;
-    size_t           weight;
-    nibble_run       value{0, 0};
+    size_t     weight;
+    uint32_t   child0{NoChild}, child1{NoChild};
+    nibble_run value{0, 0};
 
 public:
     // Construct a new leaf node for character c.
     node(nibble_run const& val, size_t const wgt) noexcept
             : weight(wgt), value(val) {}
     // Construct a new internal node that has children c1 and c2.
-    node(const shared_ptr<node>& c0, const shared_ptr<node>& c1) noexcept
-            : child0(c0), child1(c1), weight(c0->weight + c1->weight) {}
-    // Free the memory used by the child nodes.
-    void prune() noexcept {
-        child0.reset();
-        child1.reset();
-    }
+    node(size_t const wgt, uint32_t const c0, uint32_t const c1) noexcept
+            : weight(wgt), child0(c0), child1(c1) {}
     // Comparison operators.
     bool operator<(node const& other) const noexcept {
         return weight < other.weight;
@@ -149,13 +189,13 @@ class node : public enable_shared_from_this<node> {
     }
     // This tells if the node is a leaf or a branch.
     bool is_leaf() const noexcept {
-        return child0 == nullptr && child1 == nullptr;
+        return child0 == NoChild && child1 == NoChild;
     }
-    // Getters/setters for all properties.
-    shared_ptr<node const> get_child0() const noexcept {
+    // Getters for all properties.
+    uint32_t get_child0() const noexcept {
         return child0;
     }
-    shared_ptr<node const> get_child1() const noexcept {
+    uint32_t get_child1() const noexcept {
         return child1;
     }
     size_t get_weight() const noexcept {
@@ -164,35 +204,27 @@ class node : public enable_shared_from_this<node> {
     nibble_run const& get_value() const noexcept {
         return value;
     }
-    void set_child0(shared_ptr<node> c0) noexcept {
-        child0 = std::move(c0);
-    }
-    void set_child1(shared_ptr<node> c1) noexcept {
-        child1 = std::move(c1);
-    }
-    void set_weight(size_t w) noexcept {
-        weight = w;
-    }
-    void set_value(nibble_run const& v) noexcept {
-        value = v;
-    }
-    // This goes through the tree, starting with the current node, generating
-    // a map associating a nibble run with its code length.
-    void traverse(CodeSizeMap& sizemap) const noexcept {
-        if (is_leaf()) {
-            sizemap[value] += 1;
-        } else {
-            if (child0) {
-                child0->traverse(sizemap);
-            }
-            if (child1) {
-                child1->traverse(sizemap);
-            }
-        }
+};
+
+using NodePool   = vector<node>;
+using NodeVector = vector<uint32_t>;
+
+// Turns a comparison between nodes into a comparison between their positions
+// in a node pool, for the heaps of node positions.
+template <typename Compare>
+struct Compare_index {
+    NodePool const& pool;
+    Compare const&  comp;
+    bool operator()(uint32_t const lhs, uint32_t const rhs) const noexcept {
+        return comp(pool[lhs], pool[rhs]);
     }
 };
 
-using NodeVector = vector<shared_ptr<node>>;
+template <typename Compare>
+Compare_index<Compare> compare_index(
+        NodePool const& pool, Compare const& comp) noexcept {
+    return Compare_index<Compare>{pool, comp};
+}
 
 struct Compare_size {
     bool operator()(SizeFreqNibble const& lhs, SizeFreqNibble const& rhs)
@@ -220,51 +252,51 @@ struct Compare_size {
 };
 
 struct Compare_node {
-    bool operator()(shared_ptr<node> const& lhs, shared_ptr<node> const& rhs)
-            const noexcept {
+    bool operator()(node const& lhs, node const& rhs) const noexcept {
 #if 1
-        if (*lhs > *rhs) {
+        if (lhs > rhs) {
             return true;
         }
-        if (*lhs < *rhs) {
+        if (lhs < rhs) {
             return false;
         }
-        return lhs->get_value().get_count() < rhs->get_value().get_count();
+        return lhs.get_value().get_count() < rhs.get_value().get_count();
 #else
-        return *lhs > *rhs;
+        return lhs > rhs;
 #endif
     }
     // Just discard the lowest weighted item.
-    void update(NodeVector& qt, NibbleCodeMap& codes) const noexcept {
+    void update(
+            NodeVector& qt, NodePool const& pool,
+            NibbleCodeTable& codes) const noexcept {
         ignore_unused_variable_warning(codes);
-        pop_heap(qt.begin(), qt.end(), *this);
+        pop_heap(qt.begin(), qt.end(), compare_index(pool, *this));
         qt.pop_back();
     }
 };
 
 struct Compare_node2 {
-    static NibbleCodeMap codemap;
-    bool operator()(shared_ptr<node> const& lhs, shared_ptr<node> const& rhs)
+    NibbleCodeTable codemap;
+    bool            operator()(node const& lhs, node const& rhs)
             const noexcept {
         if (codemap.empty()) {
-            if (*lhs < *rhs) {
+            if (lhs < rhs) {
                 return true;
             }
-            if (*lhs > *rhs) {
+            if (lhs > rhs) {
                 return false;
             }
-            return lhs->get_value().get_count() > rhs->get_value().get_count();
+            return lhs.get_value().get_count() > rhs.get_value().get_count();
         }
-        nibble_run const left_nibble  = lhs->get_value();
-        nibble_run const right_nibble = rhs->get_value();
+        nibble_run const left_nibble  = lhs.get_value();
+        nibble_run const right_nibble = rhs.get_value();
 
-        auto get_len = [&](shared_ptr<node> const& node, nibble_run nib) {
-            auto const it = codemap.find(nib);
-            if (it == codemap.end()) {
-                return (6 + 7) * node->get_weight();
+        auto get_len = [&](node const& elem, nibble_run nib) {
+            if (!codemap.has_code(nib)) {
+                return (6 + 7) * elem.get_weight();
             }
-            size_t bitcnt = (it->second).len;
-            return (bitcnt & 0x7fU) * node->get_weight() + 16;
+            size_t bitcnt = codemap[nib].len;
+            return (bitcnt & 0x7fU) * elem.get_weight() + 16;
         };
 
         size_t const left_code_length  = get_len(lhs, left_nibble);
@@ -277,9 +309,9 @@ struct Compare_node2 {
         }
 
         size_t const left_weighted_count
-                = (left_nibble.get_count() + 1) * lhs->get_weight();
+                = (left_nibble.get_count() + 1) * lhs.get_weight();
         size_t const right_weighted_count
-                = (right_nibble.get_count() + 1) * rhs->get_weight();
+                = (right_nibble.get_count() + 1) * rhs.get_weight();
         if (left_weighted_count < right_weighted_count) {
             return true;
         }
@@ -290,142 +322,278 @@ struct Compare_node2 {
     }
     // Resort the heap using weights from the previous iteration, then discards
     // the lowest weighted item.
-    void update(NodeVector& qt, NibbleCodeMap& codes) const noexcept {
+    void update(
+            NodeVector& qt, NodePool const& pool,
+            NibbleCodeTable& codes) noexcept {
         codemap = codes;
-        make_heap(qt.begin(), qt.end(), *this);
-        pop_heap(qt.begin(), qt.end(), *this);
+        make_heap(qt.begin(), qt.end(), compare_index(pool, *this));
+        pop_heap(qt.begin(), qt.end(), compare_index(pool, *this));
         qt.pop_back();
     }
 };
 
-NibbleCodeMap Compare_node2::codemap;
+// Like Compare_node, but discards the nibble run that covers the fewest nibbles
+// of the file instead of the one that appears the fewest times.
+struct Compare_nibbles {
+    static size_t get_nibbles(node const& elem) noexcept {
+        return (elem.get_value().get_count() + 1) * elem.get_weight();
+    }
+    bool operator()(node const& lhs, node const& rhs) const noexcept {
+        size_t const left_nibbles  = get_nibbles(lhs);
+        size_t const right_nibbles = get_nibbles(rhs);
+        if (left_nibbles > right_nibbles) {
+            return true;
+        }
+        if (left_nibbles < right_nibbles) {
+            return false;
+        }
+        return lhs.get_value().get_count() < rhs.get_value().get_count();
+    }
+    // Just discard the item covering the fewest nibbles.
+    void update(
+            NodeVector& qt, NodePool const& pool,
+            NibbleCodeTable& codes) const noexcept {
+        ignore_unused_variable_warning(codes);
+        pop_heap(qt.begin(), qt.end(), compare_index(pool, *this));
+        qt.pop_back();
+    }
+};
 
-template <>
-size_t moduled_nemesis::PadMaskBits = 1U;
+// Discards the nibble run whose code saved the fewest bits over inlining it in
+// the code table from the previous iteration; nibble runs without a code saved
+// nothing. Ties are broken as in Compare_nibbles.
+struct Compare_savings {
+    NibbleCodeTable codemap;
+    int64_t         get_savings(node const& elem) const noexcept {
+        nibble_run const& run = elem.get_value();
+        if (!codemap.has_code(run)) {
+            return 0;
+        }
+        uint8_t const len = codemap[run].len;
+        // Each code in the header takes 2 bytes, but the false codes made of
+        // other codes are not in the header.
+        int64_t const header = (len & 0x80U) != 0 ? 0 : 16;
+        return int64_t(6 + 7 - (len & 0x7fU)) * int64_t(elem.get_weight())
+               - header;
+    }
+    bool operator()(node const& lhs, node const& rhs) const noexcept {
+        int64_t const left_savings  = get_savings(lhs);
+        int64_t const right_savings = get_savings(rhs);
+        if (left_savings > right_savings) {
+            return true;
+        }
+        if (left_savings < right_savings) {
+            return false;
+        }
+        return Compare_nibbles()(lhs, rhs);
+    }
+    // Resort the heap using the savings from the previous iteration, then
+    // discards the item that saved the fewest bits.
+    void update(
+            NodeVector& qt, NodePool const& pool,
+            NibbleCodeTable& codes) noexcept {
+        codemap = codes;
+        make_heap(qt.begin(), qt.end(), compare_index(pool, *this));
+        pop_heap(qt.begin(), qt.end(), compare_index(pool, *this));
+        qt.pop_back();
+    }
+};
+
+// In mode 1, each line of 4 bytes is stored XORed with the line before it.
+// These convert a buffer to and from that form in place; the size must be a
+// multiple of 4. Where SSE2 is available, they work on 4 lines at a time.
+static inline void xor_delta_encode(
+        uint8_t* const data, size_t const size) noexcept {
+    // Go backwards, so each line is XORed with the original previous line.
+    size_t pos = size;
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; pos >= sizeof(__m128i) + 4; pos -= sizeof(__m128i)) {
+        uint8_t* const block = data + pos - sizeof(__m128i);
+        __m128i        lines;
+        __m128i        prev;
+        std::memcpy(&lines, block, sizeof(__m128i));
+        std::memcpy(&prev, block - 4, sizeof(__m128i));
+        lines = _mm_xor_si128(lines, prev);
+        std::memcpy(block, &lines, sizeof(__m128i));
+    }
+#endif
+    for (; pos > 4; pos -= 4) {
+        uint32_t line;
+        uint32_t prev;
+        std::memcpy(&line, data + pos - 4, sizeof(uint32_t));
+        std::memcpy(&prev, data + pos - 8, sizeof(uint32_t));
+        line ^= prev;
+        std::memcpy(data + pos - 4, &line, sizeof(uint32_t));
+    }
+}
+
+static inline void xor_delta_decode(
+        uint8_t* const data, size_t const size) noexcept {
+    // Each line becomes the XOR of itself and all lines before it.
+    size_t   pos  = 0;
+    uint32_t prev = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i carry = _mm_setzero_si128();
+    for (; pos + sizeof(__m128i) <= size; pos += sizeof(__m128i)) {
+        __m128i lines;
+        std::memcpy(&lines, data + pos, sizeof(__m128i));
+        // Prefix XOR of the 4 lines in the block, then add in the last line
+        // of the previous block.
+        lines = _mm_xor_si128(lines, _mm_slli_si128(lines, 4));
+        lines = _mm_xor_si128(lines, _mm_slli_si128(lines, 8));
+        lines = _mm_xor_si128(lines, carry);
+        std::memcpy(data + pos, &lines, sizeof(__m128i));
+        carry = _mm_shuffle_epi32(lines, 0xFF);
+    }
+    prev = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+#endif
+    for (; pos + 4 <= size; pos += 4) {
+        uint32_t line;
+        std::memcpy(&line, data + pos, sizeof(uint32_t));
+        prev ^= line;
+        std::memcpy(data + pos, &prev, sizeof(uint32_t));
+    }
+}
 
 class nemesis_internal {
 public:
-    static void decode_header(std::istream& Src, CodeNibbleMap& codemap) {
+    // Reads the code table at the start of the data, and returns its size.
+    static size_t decode_header(
+            uint8_t const* Data, size_t const Size, CodeNibbleMap& codemap) {
+        size_t pos = 0;
+        // Reading past the end gives the value that ends the header.
+        auto getbyte = [&]() -> size_t {
+            return pos < Size ? Data[pos++] : 0xFFU;
+        };
         // storage for output value to decompression buffer
         size_t out_val = 0;
 
-        // main loop. Header is terminated by the value of 0xFF
-        for (size_t in_val = Read1(Src); in_val != 0xFF; in_val = Read1(Src)) {
+        // main loop. Header is terminated by the value of 0xFF, or by the
+        // end of the data if it is corrupt.
+        for (size_t in_val = getbyte(); in_val != 0xFF; in_val = getbyte()) {
             // if most significant bit is set, store the last 4 bits and discard
             // the rest
             if ((in_val & 0x80U) != 0) {
                 out_val = in_val & 0xfU;
-                in_val  = Read1(Src);
+                in_val  = getbyte();
             }
 
             nibble_run const run(out_val, ((in_val & 0x70U) >> 4U) + 1);
 
-            size_t const  code = Read1(Src);
+            size_t const  code = getbyte();
             uint8_t const len  = in_val & 0xfU;
             // Read the run's code from stream.
             codemap[Code{code, len}] = run;
         }
+        return pos;
     }
 
-    static void decode(
-            std::istream& Src, std::ostream& Dst, CodeNibbleMap& codemap,
-            size_t const rtiles, bool const alt_out = false) {
-        // This buffer is used for alternating mode decoding.
-        stringstream dst(ios::in | ios::out | ios::binary);
-
-        // Set bit I/O streams.
-        ibitstream<uint8_t, true> bits(Src);
-        obitstream<uint8_t>       out(dst);
-        size_t                    code = bits.pop();
-        uint8_t                   len  = 1;
-
-        // When to stop decoding: number of tiles * $20 bytes per tile * 8 bits
-        // per byte.
-        size_t total_bits   = rtiles << 8U;
-        size_t bits_written = 0;
-        while (bits_written < total_bits) {
-            if (code == 0x3f && len == 6) {
-                // Bit pattern %111111; inline RLE.
-                // First 3 bits are repetition count, followed by the inlined
-                // nibble.
-                size_t cnt    = bits.read(3) + 1;
-                size_t nibble = bits.read(4);
-                bits_written += cnt * 4;
-
-                // Write single nibble if needed.
-                if ((cnt % 2) != 0) {
-                    out.write(nibble, 4);
-                }
+    // Sets all the table entries that start with the given code, unless they
+    // already have a code which is no longer than it.
+    static void add_code(
+            CodeTable& table, size_t const code, uint8_t const len,
+            bool const inline_rle, nibble_run const& run) noexcept {
+        size_t const shift = 8U - len;
+        size_t const first = code << shift;
+        size_t const last  = first + (size_t(1) << shift);
+        for (size_t ii = first; ii < last; ii++) {
+            CodeTableEntry& entry = table[ii];
+            if (entry.len == 0 || len < entry.len) {
+                entry.len        = len;
+                entry.inline_rle = inline_rle;
+                entry.run        = run;
+            }
+        }
+    }
 
-                // Now write pairs of nibbles.
-                cnt >>= 1U;
-                nibble |= (nibble << 4U);
-                for (size_t i = 0; i < cnt; i++) {
-                    out.write(nibble, 8);
-                }
+    // Builds the table used to decode codes of up to 8 bits with a single
+    // lookup. As when reading the code one bit at a time, the shortest code
+    // that matches wins, and the inline RLE code %111111 goes before a nibble
+    // run with the same code.
+    static void build_code_table(
+            CodeNibbleMap const& codemap, CodeTable& table) noexcept {
+        table.fill(CodeTableEntry{});
+        add_code(table, 0x3f, 6, true, nibble_run{});
+        for (auto const& elem : codemap) {
+            Code const& code = elem.first;
+            // Codes that can't be read with so few bits never match.
+            if (code.len == 0 || code.len > 8
+                || code.code >= (size_t(1) << code.len)) {
+                continue;
+            }
+            add_code(table, code.code, code.len, false, elem.second);
+        }
+    }
 
-                if (bits_written >= total_bits) {
-                    break;
+    static size_t decode(
+            uint8_t const* Data, size_t const Size, vector<uint8_t>& Dst,
+            CodeNibbleMap& codemap, size_t const rtiles,
+            bool const alt_out = false) {
+        CodeTable table;
+        build_code_table(codemap, table);
+
+        // Number of tiles * $20 bytes per tile.
+        size_t const total_bytes = rtiles << 5U;
+        size_t const start       = Dst.size();
+        Dst.resize(start + total_bytes, 0);
+        uint8_t* const dst = Dst.data() + start;
+
+        ibitbuffer<uint8_t, true> bits(Data, Size);
+        // When to stop decoding: number of tiles * $40 nibbles per tile.
+        size_t const total_nibbles   = total_bytes << 1U;
+        size_t       nibbles_written = 0;
+        auto         put_run         = [&](size_t const nibble, size_t cnt) {
+            cnt = std::min(cnt, total_nibbles - nibbles_written);
+            for (size_t ii = 0; ii < cnt; ii++, nibbles_written++) {
+                uint8_t& out = dst[nibbles_written >> 1U];
+                if ((nibbles_written & 1U) != 0) {
+                    out |= nibble;
+                } else {
+                    out = uint8_t(nibble << 4U);
                 }
+            }
+        };
 
-                // Read next bit, replacing previous data.
-                code = bits.pop();
-                len  = 1;
+        // Also stop if the input runs out, as it would with corrupt data.
+        while (nibbles_written < total_nibbles && bits.good()) {
+            CodeTableEntry const& entry = table[bits.peek(8)];
+            if (entry.inline_rle) {
+                // Bit pattern %111111; inline RLE.
+                // First 3 bits are repetition count, followed by the inlined
+                // nibble.
+                bits.consume(entry.len);
+                size_t const cnt    = bits.read(3) + 1;
+                size_t const nibble = bits.read(4);
+                put_run(nibble, cnt);
+            } else if (entry.len != 0) {
+                // A nibble code: output the encoded nibble run.
+                bits.consume(entry.len);
+                put_run(entry.run.get_nibble(), entry.run.get_count());
             } else {
-                // Find out if the data so far is a nibble code.
-                auto const it = codemap.find(Code{code, len});
-                if (it != codemap.end()) {
-                    // If it is, then it is time to output the encoded nibble
-                    // run.
-                    nibble_run const& run    = it->second;
-                    size_t            nibble = run.get_nibble();
-                    size_t            cnt    = run.get_count();
-                    bits_written += cnt * 4;
-
-                    // Write single nibble if needed.
-                    if ((cnt % 2) != 0) {
-                        out.write(nibble, 4);
-                    }
-
-                    // Now write pairs of nibbles.
-                    cnt >>= 1U;
-                    nibble |= (nibble << 4U);
-                    for (size_t i = 0; i < cnt; i++) {
-                        out.write(nibble, 8);
-                    }
-
-                    if (bits_written >= total_bits) {
-                        break;
-                    }
-
-                    // Read next bit, replacing previous data.
-                    code = bits.pop();
-                    len  = 1;
-                } else {
-                    // Read next bit and append to current data.
+                // Corrupt or unusual data: there is no code of up to 8 bits
+                // here, so keep reading one bit at a time until the data so
+                // far is a nibble code.
+                size_t  code = bits.read(8);
+                uint8_t len  = 8;
+                auto    it   = codemap.end();
+                while (bits.good()) {
                     code = (code << 1U) | bits.pop();
                     len++;
+                    it = codemap.find(Code{code, len});
+                    if (it != codemap.end()) {
+                        break;
+                    }
+                }
+                if (it != codemap.end()) {
+                    put_run(it->second.get_nibble(), it->second.get_count());
                 }
             }
         }
 
-        // Write out any remaining bits, padding with zeroes.
-        out.flush();
-
         if (alt_out) {
-            // For alternating decoding, we must now incrementally XOR and
-            // output the lines.
-            dst.seekg(0);
-            dst.clear();
-            uint32_t in = LittleEndian::Read4(dst);
-            LittleEndian::Write4(Dst, in);
-            while (size_t(dst.tellg()) < (rtiles << 5U)) {
-                in ^= LittleEndian::Read4(dst);
-                LittleEndian::Write4(Dst, in);
-            }
-        } else {
-            Dst.write(dst.str().c_str(), rtiles << 5U);
+            xor_delta_decode(dst, total_bytes);
         }
+        return bits.tell();
     }
 
     template <size_t N>
@@ -434,69 +602,77 @@ class nemesis_internal {
     using Matrix = std::array<Row<N>, M>;
 
     static size_t estimate_file_size(
-            NibbleCodeMap& tempcodemap, RunCountMap& counts) {
+            NibbleCodeTable& tempcodemap, RunCountTable const& counts) {
         // We now compute the final file size for this code table.
         // 2 bytes at the start of the file, plus 1 byte at the end of the
         // code table.
         size_t tempsize_est = size_t(3) * 8;
         size_t last         = 0xff;
         // Start with any nibble runs with their own code.
-        for (auto& elem : tempcodemap) {
+        for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
+            nibble_run const run = nibble_run::from_index(ii);
+            if (!tempcodemap.has_code(run)) {
+                continue;
+            }
             // Each new nibble needs an extra byte.
-            if (last != elem.first.get_nibble()) {
+            if (last != run.get_nibble()) {
                 tempsize_est += 8;
                 // Be sure to SET the last nibble to the current nibble... this
                 // fixes a bug that caused file sizes to increase in some cases.
-                last = elem.first.get_nibble();
+                last = run.get_nibble();
             }
             // 2 bytes per nibble run in the table.
             tempsize_est += size_t(2 * 8);
             // How many bits this nibble run uses in the file.
-            tempsize_est += counts[elem.first] * (elem.second).len;
+            tempsize_est += counts[ii] * tempcodemap[run].len;
         }
 
-        // Supplementary code map for the nibble runs that can be broken up into
-        // shorter nibble runs with a smaller bit length than inlining.
-        NibbleCodeMap supcodemap;
+        // Supplementary code table for the nibble runs that can be broken up
+        // into shorter nibble runs with a smaller bit length than inlining.
+        NibbleCodeTable supcodemap;
         // Now we will compute the size requirements for inline nibble runs.
-        for (auto& count : counts) {
+        for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
+            if (counts[ii] == 0) {
+                continue;
+            }
+            nibble_run const run  = nibble_run::from_index(ii);
+            size_t const     freq = counts[ii];
             // Find out if this nibble run has a code for it.
-            auto it2 = tempcodemap.find(count.first);
-            if (it2 == tempcodemap.end()) {
+            if (!tempcodemap.has_code(run)) {
                 // Nibble run does not have its own code. We need to find out if
                 // we can break it up into smaller nibble runs with total code
                 // size less than 13 bits or if we need to inline it (13 bits).
-                if (count.first.get_count() == 0) {
+                if (run.get_count() == 0) {
                     // If this is a nibble run with zero repeats, we can't break
                     // it up into smaller runs, so we inline it.
-                    tempsize_est += (6 + 7) * count.second;
-                } else if (count.first.get_count() == 1) {
+                    tempsize_est += (6 + 7) * freq;
+                } else if (run.get_count() == 1) {
                     // We stand a chance of breaking the nibble run.
 
                     // This case is rather trivial, so we hard-code it.
                     // We can break this up only as 2 consecutive runs of a
                     // nibble run with count == 0.
-                    nibble_run trg{count.first.get_nibble(), 0};
-                    it2 = tempcodemap.find(trg);
-                    if (it2 == tempcodemap.end() || (it2->second).len > 6) {
+                    nibble_run trg{run.get_nibble(), 0};
+                    if (!tempcodemap.has_code(trg)
+                        || tempcodemap[trg].len > 6) {
                         // The smaller nibble run either does not have its own
                         // code or it results in a longer bit code when doubled
                         // up than would result from inlining the run. In either
                         // case, we inline the nibble run.
-                        tempsize_est += (6 + 7) * count.second;
+                        tempsize_est += (6 + 7) * freq;
                     } else {
                         // The smaller nibble run has a small enough code that
                         // it is more efficient to use it twice than to inline
                         // our nibble run. So we do exactly that, by adding a
                         // (temporary) entry in the supplementary codemap, which
                         // will later be merged into the main codemap.
-                        size_t  code = (it2->second).code;
-                        uint8_t len  = (it2->second).len;
+                        size_t  code = tempcodemap[trg].code;
+                        uint8_t len  = tempcodemap[trg].len;
                         code         = (code << len) | code;
                         len <<= 1U;
-                        tempsize_est += len * count.second;
+                        tempsize_est += len * freq;
                         len |= 0x80U;    // Flag this as a false code.
-                        supcodemap[count.first] = Code{code, len};
+                        supcodemap.set(run, Code{code, len});
                     }
                 } else {
                     // We stand a chance of breaking it the nibble run.
@@ -550,7 +726,7 @@ class nemesis_internal {
                             Row<7>{0, 1, 0, 0, 0, 1, 0},
                             Row<7>{0, 0, 1, 0, 1, 0, 0},
                             Row<7>{0, 0, 0, 2, 0, 0, 0}};
-                    size_t const n = count.first.get_count();
+                    size_t const n = run.get_count();
                     // Pointer to table of linear coefficients. This table has N
                     // columns for each line.
                     size_t const* linear_coefficients;
@@ -584,23 +760,22 @@ class nemesis_internal {
                         break;
                     }
 
-                    uint8_t const nibble = count.first.get_nibble();
-                    // Vector containing the code length of each nibble run, or
+                    uint8_t const nibble = run.get_nibble();
+                    // Array containing the code length of each nibble run, or
                     // 13 if the nibble run is not in the codemap.
-                    vector<size_t> runlen;
-                    // Init vector.
+                    std::array<size_t, 7> runlen{};
+                    // Init array.
                     for (size_t i = 0; i < n; i++) {
                         // Is this run in the codemap?
                         nibble_run trg(nibble, i);
-                        auto       it3 = tempcodemap.find(trg);
-                        if (it3 == tempcodemap.end()) {
+                        if (!tempcodemap.has_code(trg)) {
                             // It is not.
-                            // Put inline length in the vector.
-                            runlen.push_back(6 + 7);
+                            // Put inline length in the array.
+                            runlen[i] = 6 + 7;
                         } else {
                             // It is.
-                            // Put code length in the vector.
-                            runlen.push_back((it3->second).len);
+                            // Put code length in the array.
+                            runlen[i] = tempcodemap[trg].len;
                         }
                     }
 
@@ -641,37 +816,41 @@ class nemesis_internal {
                             }
                             // Is this run in the codemap?
                             nibble_run trg(nibble, i);
-                            auto       it3 = tempcodemap.find(trg);
-                            if (it3 != tempcodemap.end()) {
+                            if (tempcodemap.has_code(trg)) {
                                 // It is; it MUST be, as the other case is
                                 // impossible by construction.
                                 for (size_t j = 0; j < c; j++) {
-                                    len += (it3->second).len;
-                                    code <<= (it3->second).len;
-                                    code |= (it3->second).code;
+                                    len += tempcodemap[trg].len;
+                                    code <<= tempcodemap[trg].len;
+                                    code |= tempcodemap[trg].code;
                                 }
                             }
                         }
                         if (len != best_size) {
                             // ERROR! DANGER! THIS IS IMPOSSIBLE!
                             // But just in case...
-                            tempsize_est += (6 + 7) * count.second;
+                            tempsize_est += (6 + 7) * freq;
                         } else {
                             // By construction, best_size is at most 12.
                             // Flag it as a false code.
                             uint8_t const mlen = best_size | 0x80U;
                             // Add it to supplementary code map.
-                            supcodemap[count.first] = Code{code, mlen};
-                            tempsize_est += best_size * count.second;
+                            supcodemap.set(run, Code{code, mlen});
+                            tempsize_est += best_size * freq;
                         }
                     } else {
                         // No, we will have to inline it.
-                        tempsize_est += (6 + 7) * count.second;
+                        tempsize_est += (6 + 7) * freq;
                     }
                 }
             }
         }
-        tempcodemap.insert(supcodemap.begin(), supcodemap.end());
+        for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
+            nibble_run const run = nibble_run::from_index(ii);
+            if (supcodemap.has_code(run)) {
+                tempcodemap.set(run, supcodemap[run]);
+            }
+        }
 
         // Round up to a full byte.
         tempsize_est = (tempsize_est + 7) & ~7U;
@@ -679,59 +858,66 @@ class nemesis_internal {
         return tempsize_est;
     }
 
-    template <typename Compare>
-    static size_t encode(
-            istream& Src, ostream& Dst, size_t mode, size_t const sz,
-            Compare const& comp) {
-        // Seek to start and clear all errors.
-        Src.clear();
-        Src.seekg(0);
-        // Unpack source so we don't have to deal with nibble IO after.
-        vector<uint8_t> unpack;
-        for (size_t i = 0; i < sz; i++) {
-            size_t const c = Read1(Src);
-            unpack.push_back((c & 0xf0U) >> 4U);
-            unpack.push_back((c & 0x0fU));
-        }
-        unpack.push_back(0xff);
-
-        // Build RLE nibble runs, RLE-encoding the nibble runs as we go along.
-        // Maximum run length is 8, meaning 7 repetitions.
-        vector<nibble_run> rleSrc;
-        RunCountMap        counts;
-        nibble_run         curr{unpack[0], 0};
-        for (size_t i = 1; i < unpack.size(); i++) {
-            nibble_run next{unpack[i], 0};
-            if (next.get_nibble() != curr.get_nibble()
-                || curr.get_count() >= 7) {
+    // Builds RLE nibble runs, RLE-encoding the nibble runs as we go along,
+    // straight from the bytes of the source, and counts how many times each
+    // nibble run appears. Maximum run length is 8, meaning 7 repetitions.
+    static void build_runs(
+            uint8_t const* Src, size_t const sz, vector<nibble_run>& rleSrc,
+            RunCountTable& counts) {
+        rleSrc.clear();
+        counts.fill(0);
+
+        auto add_nibble = [&](nibble_run& curr, uint8_t const nibble) {
+            if (nibble != curr.get_nibble() || curr.get_count() >= 7) {
                 rleSrc.push_back(curr);
-                counts[curr] += 1;
-                curr = next;
+                counts[curr.index()] += 1;
+                curr = nibble_run{nibble, 0};
             } else {
                 curr.set_count(curr.get_count() + 1);
             }
+        };
+        if (sz != 0) {
+            rleSrc.reserve(2 * sz);
+            nibble_run curr{uint8_t(Src[0] >> 4U), 0};
+            add_nibble(curr, Src[0] & 0x0fU);
+            for (size_t i = 1; i < sz; i++) {
+                add_nibble(curr, Src[i] >> 4U);
+                add_nibble(curr, Src[i] & 0x0fU);
+            }
+            rleSrc.push_back(curr);
+            counts[curr.index()] += 1;
         }
-        // No longer needed.
-        unpack.clear();
-
-        Compare_node2::codemap.clear();
+    }
 
+    // Finds the code table that gives the smallest file for the nibble runs
+    // with the given counts, dropping nibble runs from the code table in the
+    // order given by comp. Returns the file size for the code table, in bits
+    // (but rounded up to a full byte).
+    template <typename Compare>
+    static size_t build_codes(
+            RunCountTable const& counts, Compare comp,
+            NibbleCodeTable& codemap) {
         // We will use the Package-merge algorithm to build the optimal
         // length-limited Huffman code for the current file. To do this, we must
         // map the current problem onto the Coin Collector's problem. Build the
         // basic coin collection.
+        // All nodes go in this pool: the leaves first, then the packages made
+        // by each solution of the Coin Collector's problem, which are dropped
+        // before the next one.
+        NodePool   pool;
         NodeVector qt;
-        qt.reserve(counts.size());
-        for (auto& count : counts) {
+        for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
             // No point in including anything with weight less than 2, as they
             // would actually increase compressed file size if used.
-            if (count.second > 1) {
-                qt.push_back(make_shared<node>(count.first, count.second));
+            if (counts[ii] > 1) {
+                qt.push_back(pool.size());
+                pool.emplace_back(nibble_run::from_index(ii), counts[ii]);
             }
         }
+        size_t const numleaves = pool.size();
         // This may seem useless, but my tests all indicate that this reduces
         // the average file size. I haven't the foggiest idea why.
-        make_heap(qt.begin(), qt.end(), comp);
+        make_heap(qt.begin(), qt.end(), compare_index(pool, comp));
 
         // The base coin collection for the length-limited Huffman coding has
         // one coin list per character in length of the limitation. Each coin
@@ -740,30 +926,54 @@ class nemesis_internal {
         // code is structured below; the "numismatic value" of each coin is the
         // number of times the underlying nibble run appears in the source file.
 
-        // This will hold the Huffman code map.
+        // The codemap will hold the Huffman code map.
         // NOTE: while the codes that will be written in the header will not be
         // longer than 8 bits, it is possible that a supplementary code map will
         // add "fake" codes that are longer than 8 bits.
-        NibbleCodeMap codemap;
+        codemap.clear();
         // Size estimate. This is used to build the optimal compressed file.
         size_t size_est = 0xffffffff;
 
         // We will solve the Coin Collector's problem several times, each time
         // ignoring more of the least frequent nibble runs. This allows us to
         // find *the* lowest file size.
+        // These are the coin lists used by the Package-merge algorithm, as
+        // heaps ordered as for a priority_queue. They are kept between
+        // solutions so their memory can be reused.
+        Compare_node const coin_compare;
+        auto const         coin_order = compare_index(pool, coin_compare);
+        NodeVector q0;
+        NodeVector q;
+        NodeVector q1;
+        // The solution goes here.
+        NodeVector solution;
+        // How many times each node is part of the solution.
+        vector<size_t> uses;
+        // The nibble runs and codes of each solution, as used below.
+        vector<SizeFreqNibble> sizemap;
+        vector<Code>           codes;
+
+        auto pop_coin = [&](NodeVector& coins) {
+            pop_heap(coins.begin(), coins.end(), coin_order);
+            uint32_t const coin = coins.back();
+            coins.pop_back();
+            return coin;
+        };
+
         while (qt.size() > 1) {
+            // Start over with only the leaves.
+            pool.erase(pool.begin() + numleaves, pool.end());
             // Make a copy of the basic coin collection.
-            using CoinQueue = priority_queue<
-                    shared_ptr<node>, NodeVector, Compare_node>;
-            CoinQueue q0(qt.begin(), qt.end());
+            q0.assign(qt.begin(), qt.end());
+            make_heap(q0.begin(), q0.end(), coin_order);
 
             // We now solve the Coin collector's problem using the Package-merge
-            // algorithm. The solution goes here.
-            NodeVector solution;
+            // algorithm.
+            solution.clear();
             // This holds the packages from the last iteration.
-            CoinQueue q(q0);
-            size_t    target = (q0.size() - 1) << 8U;
-            size_t    idx    = 0;
+            q.assign(q0.begin(), q0.end());
+            size_t target = (q0.size() - 1) << 8U;
+            size_t idx    = 0;
             while (target != 0) {
                 // Gets lowest bit set in its proper place:
                 size_t val = (target & -target);
@@ -772,43 +982,55 @@ class nemesis_internal {
                 if (r == val) {
                     // If yes, take the least valuable node and put it into the
                     // solution.
-                    solution.push_back(q.top());
-                    q.pop();
+                    solution.push_back(pop_coin(q));
                     target -= r;
                 }
 
                 // The coin collection has coins of values 1 to 8; copy from the
                 // original in those cases for the next step.
-                CoinQueue q1;
+                q1.clear();
                 if (idx < 7) {
-                    q1 = q0;
+                    q1.assign(q0.begin(), q0.end());
                 }
 
                 // Split the current list into pairs and insert the packages
                 // into the next list.
                 while (q.size() > 1) {
-                    shared_ptr<node> child1 = q.top();
-                    q.pop();
-                    shared_ptr<node> child0 = q.top();
-                    q.pop();
-                    q1.push(make_shared<node>(child0, child1));
+                    uint32_t const child1 = pop_coin(q);
+                    uint32_t const child0 = pop_coin(q);
+                    q1.push_back(pool.size());
+                    pool.emplace_back(
+                            pool[child0].get_weight()
+                                    + pool[child1].get_weight(),
+                            child0, child1);
+                    push_heap(q1.begin(), q1.end(), coin_order);
                 }
                 idx++;
-                q = q1;
+                std::swap(q, q1);
             }
 
             // The Coin Collector's problem has been solved. Now it is time to
             // map the solution back into the length-limited Huffman coding
             // problem.
 
-            // To do that, we iterate through the solution and count how many
-            // times each nibble run has been used (remember that the coin
-            // collection had multiple coins associated with each nibble run) --
-            // this number is the optimal bit length for the nibble run for the
-            // current coin collection.
-            CodeSizeMap basesizemap;
-            for (auto& elem : solution) {
-                (elem)->traverse(basesizemap);
+            // To do that, we count how many times each nibble run has been used
+            // (remember that the coin collection had multiple coins associated
+            // with each nibble run) -- this number is the optimal bit length
+            // for the nibble run for the current coin collection. Packages
+            // come after their children in the pool, so going backwards passes
+            // the uses of each package down to its children before they are
+            // looked at.
+            uses.assign(pool.size(), 0);
+            for (auto const elem : solution) {
+                uses[elem]++;
+            }
+            for (size_t ii = pool.size(); ii-- > numleaves;) {
+                uses[pool[ii].get_child0()] += uses[ii];
+                uses[pool[ii].get_child1()] += uses[ii];
+            }
+            CodeSizeTable basesizemap{};
+            for (size_t ii = 0; ii < numleaves; ii++) {
+                basesizemap[pool[ii].get_value().index()] = uint8_t(uses[ii]);
             }
 
             // With the length-limited Huffman coding problem solved, it is now
@@ -820,17 +1042,21 @@ class nemesis_internal {
             // any given code length. Since there are only 8 valid code lengths,
             // we only need this simple array.
             std::array<size_t, 8> sizecounts{0};
-            // This set contains lots more information, and is used to associate
-            // the nibble run with its optimal code. It is sorted by code size,
-            // then by frequency of the nibble run, then by the nibble run.
-            using SizeSet = multiset<SizeFreqNibble, Compare_size>;
-            SizeSet sizemap;
-            for (auto& elem : basesizemap) {
-                uint8_t size  = elem.second;
-                size_t  count = counts[elem.first];
+            // This vector contains lots more information, and is used to
+            // associate the nibble run with its optimal code. It is sorted by
+            // code size, then by frequency of the nibble run, then by the
+            // nibble run.
+            sizemap.clear();
+            for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
+                uint8_t const size = basesizemap[ii];
+                if (size == 0) {
+                    continue;
+                }
                 sizecounts[size - 1]++;
-                sizemap.emplace(count, elem.first, size);
+                sizemap.emplace_back(
+                        counts[ii], nibble_run::from_index(ii), size);
             }
+            std::sort(sizemap.begin(), sizemap.end(), Compare_size());
 
             // We now build the canonical Huffman code table.
             // "base" is the code for the first nibble run with a given bit
@@ -840,7 +1066,7 @@ class nemesis_internal {
             size_t base  = 0;
             size_t carry = 0;
             // This vector contains the codes sorted by size.
-            vector<Code> codes;
+            codes.clear();
             for (uint8_t i = 1; i <= 8; i++) {
                 // How many nibble runs have the desired bit length.
                 size_t       cnt  = sizecounts[i - 1] + carry;
@@ -867,11 +1093,11 @@ class nemesis_internal {
             }
 
             // With the canonical table build, the codemap can finally be built.
-            NibbleCodeMap tempcodemap;
-            size_t        pos = 0;
+            NibbleCodeTable tempcodemap;
+            size_t          pos = 0;
             for (auto it = sizemap.begin();
                  it != sizemap.end() && pos < codes.size(); ++it, pos++) {
-                tempcodemap[it->nibble] = codes[pos];
+                tempcodemap.set(it->nibble, codes[pos]);
             }
 
             // We now compute the final file size for this code table.
@@ -879,7 +1105,7 @@ class nemesis_internal {
 
             // This may resort the items. After that, it will discard the lowest
             // weighted item.
-            comp.update(qt, tempcodemap);
+            comp.update(qt, pool, tempcodemap);
 
             // Is this iteration better than the best?
             if (tempsize_est < size_est) {
@@ -890,9 +1116,9 @@ class nemesis_internal {
         }
         // Special case.
         if (qt.size() == 1) {
-            NibbleCodeMap    tempcodemap;
-            shared_ptr<node> child          = qt.front();
-            tempcodemap[child->get_value()] = Code{0U, 1};
+            NibbleCodeTable tempcodemap;
+            node const&     child = pool[qt.front()];
+            tempcodemap.set(child.get_value(), Code{0U, 1});
             size_t const tempsize_est = estimate_file_size(tempcodemap, counts);
 
             // Is this iteration better than the best?
@@ -902,18 +1128,29 @@ class nemesis_internal {
                 size_est = tempsize_est;
             }
         }
-        // This is no longer needed.
-        counts.clear();
+        if (codemap.empty()) {
+            // There is nothing worth a code, so everything will be inlined.
+            size_est = estimate_file_size(codemap, counts);
+        }
+        return size_est;
+    }
 
+    // Writes the file for the nibble runs, using the given code table.
+    static void write_file(
+            ostream& Dst, size_t const mode, size_t const sz,
+            vector<nibble_run> const& rleSrc, NibbleCodeTable const& codemap) {
         // We now have a prefix-free code map associating the RLE-encoded nibble
         // runs with their code. Now we write the file.
         // Write header.
         BigEndian::Write2(Dst, (mode << 15U) | (sz >> 5U));
         uint8_t lastnibble = 0xff;
-        for (auto& elem : codemap) {
-            nibble_run const& run  = elem.first;
-            size_t const      code = (elem.second).code;
-            uint8_t           len  = (elem.second).len;
+        for (size_t ii = 0; ii < nibble_run::NumRuns; ii++) {
+            nibble_run const run = nibble_run::from_index(ii);
+            if (!codemap.has_code(run)) {
+                continue;
+            }
+            size_t const code = codemap[run].code;
+            uint8_t      len  = codemap[run].len;
             // len with bit 7 set is a special device for further reducing file
             // size, and should NOT be on the table.
             if ((len & 0x80U) != 0) {
@@ -936,14 +1173,13 @@ class nemesis_internal {
         obitstream<uint8_t> bits(Dst);
 
         // The RLE-encoded source makes for a far faster encode as we simply
-        // use the nibble runs as an index into the map, meaning a quick binary
-        // search gives us the code to use (if in the map) or tells us that we
-        // need to use inline RLE.
+        // use the nibble runs as an index into the table, which gives us the
+        // code to use (if in the table) or tells us that we need to use inline
+        // RLE.
         for (auto& run : rleSrc) {
-            auto val = codemap.find(run);
-            if (val != codemap.end()) {
-                size_t const code = (val->second).code;
-                uint8_t      len  = (val->second).len;
+            if (codemap.has_code(run)) {
+                size_t const code = codemap[run].code;
+                uint8_t      len  = codemap[run].len;
                 // len with bit 7 set is a device to bypass the code table at
                 // the start of the file. We need to clear the bit here before
                 // writing the code to the file.
@@ -964,80 +1200,132 @@ class nemesis_internal {
         }
         // Fill remainder of last byte with zeroes and write if needed.
         bits.flush();
-        return Dst.tellp();
     }
 };
 
 bool nemesis::decode(istream& Src, ostream& Dst) {
-    CodeNibbleMap codemap;
-    size_t        rtiles = BigEndian::Read2(Src);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
+    extract(Src, in);
+
+    vector<uint8_t> out;
+    size_t const    Consumed = decode(in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
+    return true;
+}
+
+size_t nemesis::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    if (Size < 2) {
+        return Size;
+    }
+    uint8_t const* header = data;
+    size_t         rtiles = BigEndian::Read2(header);
     // sets the output mode based on the value of the first bit
-    bool alt_out = (rtiles & 0x8000U) != 0;
+    bool const alt_out = (rtiles & 0x8000U) != 0;
     rtiles &= 0x7fffU;
 
-    if (rtiles > 0) {
-        nemesis_internal::decode_header(Src, codemap);
-        nemesis_internal::decode(Src, Dst, codemap, rtiles, alt_out);
+    if (rtiles == 0) {
+        return 2;
     }
-    return true;
+    CodeNibbleMap codemap;
+    size_t const  HeaderSize
+            = 2 + nemesis_internal::decode_header(data + 2, Size - 2, codemap);
+    return HeaderSize
+           + nemesis_internal::decode(
+                   data + HeaderSize, Size - HeaderSize, Dst, codemap, rtiles,
+                   alt_out);
 }
 
-bool nemesis::encode(istream& Src, ostream& Dst) {
-    // We will use these as output buffers, as well as an input/output
-    // buffers for the padded Nemesis input.
-    stringstream src(ios::in | ios::out | ios::binary);
-
-    // Copy to buffer.
-    src << Src.rdbuf();
+bool nemesis::encode(
+        istream& Src, ostream& Dst, NemesisSearch const search) {
+    size_t Start = Src.tellg();
+    Src.ignore(numeric_limits<streamsize>::max());
+    size_t const FullSize = Src.gcount();
+    Src.seekg(Start);
+    vector<uint8_t> data(FullSize);
+    Src.read(reinterpret_cast<char*>(data.data()), FullSize);
+    return encode(Dst, data.data(), data.size(), search);
+}
 
+bool nemesis::encode(
+        std::ostream& Dst, uint8_t const* data, size_t const Size,
+        NemesisSearch const search) {
     // Pad source with zeroes until it is a multiple of 32 bytes.
-    size_t const pos = src.tellp();
-    if ((pos % 32) != 0) {
-        fill_n(ostreambuf_iterator<char>(src), 32 - (pos % 32), 0);
-    }
-    size_t const sz = src.tellp();
-
-    // Now we will build the alternating bit stream for mode 1 compression.
-    src.clear();
-    src.seekg(0);
-
-    string sin   = src.str();
-    auto*  bytes = reinterpret_cast<uint8_t*>(&sin[0]);
-    for (size_t i = sin.size() - 4; i > 0; i -= 4) {
-        bytes[i + 0] ^= bytes[i - 4];
-        bytes[i + 1] ^= bytes[i - 3];
-        bytes[i + 2] ^= bytes[i - 2];
-        bytes[i + 3] ^= bytes[i - 1];
-    }
-    stringstream alt(sin, ios::in | ios::out | ios::binary);
-
-    std::array<stringstream, 4> buffers;
-    // Four different attempts to encode, for improved file size.
-    std::array<size_t, 4> sizes{
-            nemesis_internal::encode(src, buffers[0], 0, sz, Compare_node()),
-            nemesis_internal::encode(src, buffers[1], 0, sz, Compare_node2()),
-            nemesis_internal::encode(alt, buffers[2], 1, sz, Compare_node()),
-            nemesis_internal::encode(alt, buffers[3], 1, sz, Compare_node2())};
-
-    // Figure out what was the best encoding.
-    size_t best_size  = numeric_limits<size_t>::max();
-    size_t beststream = 0;
-    for (size_t ii = 0; ii < sizes.size(); ii++) {
-        if (sizes[ii] < best_size) {
-            best_size  = sizes[ii];
-            beststream = ii;
-        }
+    vector<uint8_t> src(data, data + Size);
+    src.resize((Size + 31U) & ~size_t(31U), 0);
+    size_t const sz = src.size();
+
+    // The nibble runs for each mode. Only the runs are needed after this, so
+    // the alternating bit stream for mode 1 is built over the source.
+    std::array<vector<nibble_run>, 2> runs;
+    std::array<RunCountTable, 2>      counts;
+    nemesis_internal::build_runs(src.data(), sz, runs[0], counts[0]);
+    xor_delta_encode(src.data(), sz);
+    nemesis_internal::build_runs(src.data(), sz, runs[1], counts[1]);
+
+    // Several different attempts to encode, for improved file size. Each one
+    // uses a mode and an order in which to drop nibble runs from the code
+    // table; the attempts are independent, so they can run at the same time.
+    enum class DropOrder { node, node2, nibbles, savings };
+    struct Attempt {
+        size_t          mode;
+        DropOrder       order;
+        NibbleCodeTable codemap;
+        size_t          size;
+    };
+    vector<Attempt> attempts{
+            Attempt{0, DropOrder::node, {}, 0},
+            Attempt{0, DropOrder::node2, {}, 0},
+            Attempt{1, DropOrder::node, {}, 0},
+            Attempt{1, DropOrder::node2, {}, 0}};
+    if (search == NemesisSearch::extended) {
+        attempts.push_back(Attempt{0, DropOrder::nibbles, {}, 0});
+        attempts.push_back(Attempt{0, DropOrder::savings, {}, 0});
+        attempts.push_back(Attempt{1, DropOrder::nibbles, {}, 0});
+        attempts.push_back(Attempt{1, DropOrder::savings, {}, 0});
     }
 
-    buffers[beststream].seekg(0);
-    Dst << buffers[beststream].rdbuf();
+    auto const run_attempt = [&](Attempt& attempt) {
+        RunCountTable const& count = counts[attempt.mode];
+        NibbleCodeTable&     codes = attempt.codemap;
+        switch (attempt.order) {
+        case DropOrder::node:
+            attempt.size = nemesis_internal::build_codes(
+                    count, Compare_node(), codes);
+            break;
+        case DropOrder::node2:
+            attempt.size = nemesis_internal::build_codes(
+                    count, Compare_node2(), codes);
+            break;
+        case DropOrder::nibbles:
+            attempt.size = nemesis_internal::build_codes(
+                    count, Compare_nibbles(), codes);
+            break;
+        case DropOrder::savings:
+            attempt.size = nemesis_internal::build_codes(
+                    count, Compare_savings(), codes);
+            break;
+        }
+    };
+    parallel_for(
+            attempts.size(), 1,
+            std::min(hardware_thread_count(), attempts.size()),
+            [&](size_t const first, size_t const last) {
+                for (size_t ii = first; ii < last; ii++) {
+                    run_attempt(attempts[ii]);
+                }
+            });
+
+    // Figure out what was the best encoding. The sizes found along with the
+    // code tables are exact, so only the best attempt needs to be written.
+    auto const best = std::min_element(
+            attempts.cbegin(), attempts.cend(),
+            [](Attempt const& lhs, Attempt const& rhs) {
+                return lhs.size < rhs.size;
+            });
+    nemesis_internal::write_file(
+            Dst, best->mode, sz, runs[best->mode], best->codemap);
     return true;
 }
-
-bool nemesis::encode(
-        std::ostream& Dst, uint8_t const* data, size_t const Size) {
-    stringstream Src(ios::in | ios::out | ios::binary);
-    Src.write(reinterpret_cast<char const*>(data), Size);
-    Src.seekg(0);
-    return encode(Src, Dst);
-}
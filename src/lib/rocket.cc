@@ -20,6 +20,7 @@
 #include <mdcomp/bitstream.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 #include <mdcomp/rocket.hh>
 
 #include <cstdint>
@@ -28,6 +29,7 @@
 #include <ostream>
 #include <sstream>
 #include <type_traits>
+#include <vector>
 
 using std::array;
 using std::fill_n;
@@ -40,9 +42,7 @@ using std::ostream;
 using std::ostreambuf_iterator;
 using std::streamsize;
 using std::stringstream;
-
-template <>
-size_t moduled_rocket::PadMaskBits = 1U;
+using std::vector;
 
 struct rocket_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -69,6 +69,9 @@ struct rocket_internal {
         constexpr static bool const DescriptorLittleEndianBits = true;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0x3C0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 0x400;
         // Size of the look-ahead buffer.
@@ -123,25 +126,28 @@ struct rocket_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst) {
+    static size_t decode(
+            uint8_t const* Data, size_t const FullSize, vector<uint8_t>& Dst) {
         using RockIStream = LZSSIStream<RocketAdaptor>;
         using diff_t      = make_signed_t<size_t>;
 
-        in.ignore(2);
-        size_t const Size = BigEndian::Read2(in) + 4;
-        RockIStream  src(in);
+        if (FullSize < 4) {
+            return FullSize;
+        }
+        uint8_t const* header = Data + 2;
+        size_t const   Size   = BigEndian::Read2(header);
+        RockIStream    src(Data + 4, FullSize - 4);
 
-        while (in.good() && size_t(in.tellg()) < Size) {
+        while (src.good() && src.tell() < Size) {
             if (src.descbit() != 0U) {
                 // Symbolwise match.
-                uint8_t const Byte = Read1(in);
-                Write1(Dst, Byte);
+                Dst.push_back(src.getbyte());
             } else {
                 // Dictionary match.
                 // Distance and length of match.
                 size_t const high   = src.getbyte();
                 size_t const low    = src.getbyte();
-                diff_t const base   = diff_t(Dst.tellp());
+                diff_t const base   = diff_t(Dst.size());
                 diff_t       length = ((high & 0xFCU) >> 2U) + 1U;
                 diff_t       offset = ((high & 3U) << 8U) | low;
                 // The offset is stored as being absolute within a 0x400-byte
@@ -158,28 +164,30 @@ struct rocket_internal {
                     diff_t cnt = (offset + length < 0)
                                          ? length
                                          : (length - (offset + length));
-                    fill_n(ostreambuf_iterator<char>(Dst), cnt, 0x20);
+                    Dst.insert(Dst.end(), cnt, 0x20);
                     length -= cnt;
                     offset += cnt;
                 }
-                for (diff_t csrc = offset; csrc < offset + length; csrc++) {
-                    diff_t const Pointer = diff_t(Dst.tellp());
-                    Dst.seekg(csrc);
-                    uint8_t const Byte = Read1(Dst);
-                    Dst.seekp(Pointer);
-                    Write1(Dst, Byte);
+                if (length > 0) {
+                    copy_match(Dst, diff_t(Dst.size()) - offset, length);
                 }
             }
         }
+        return src.tell() + 4;
     }
 
-    static void encode(ostream& Dst, uint8_t const*& Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const*& Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType    = typename RocketAdaptor::EdgeType;
         using RockOStream = LZSSOStream<RocketAdaptor>;
 
         // Compute optimal Rocket parsing of input file.
-        auto        list = find_optimal_lzss_parse(Data, Size, RocketAdaptor{});
-        RockOStream out(Dst);
+        auto const&  list = find_optimal_lzss_parse(
+                Data, Size, RocketAdaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        RockOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -209,30 +217,48 @@ struct rocket_internal {
 };
 
 bool rocket::decode(istream& Src, iostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    rocket_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed
+            = rocket_internal::decode(in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
-bool rocket::encode(istream& Src, ostream& Dst) {
+size_t rocket::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return rocket_internal::decode(data, Size, Dst);
+}
+
+bool rocket::encode(
+        istream& Src, ostream& Dst, LZSSEffort const effort,
+        size_t const numthreads, MatchFinder const matchfinder,
+        LZSSWorkspace& workspace) {
     // We will pre-fill the buffer with 0x3C0 0x20's.
     stringstream in(ios::in | ios::out | ios::binary);
     fill_n(ostreambuf_iterator<char>(in),
            rocket_internal::RocketAdaptor::FirstMatchPosition, 0x20);
-    // Copy to buffer.
+    // Copy to buffer. An empty input sets the failbit, which must be cleared
+    // before we can go back to the start.
     in << Src.rdbuf();
+    in.clear();
     in.seekg(0);
-    return basic_rocket::encode(in, Dst);
+    return basic_rocket::encode(
+            in, Dst, effort, numthreads, matchfinder, workspace);
 }
 
-bool rocket::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
+bool rocket::encode(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        LZSSEffort const effort, size_t const numthreads,
+        MatchFinder const matchfinder, LZSSWorkspace& workspace) {
     // Internal buffer.
     stringstream outbuff(ios::in | ios::out | ios::binary);
-    rocket_internal::encode(outbuff, data, Size);
+    rocket_internal::encode(
+            outbuff, data, Size, effort, numthreads, matchfinder, workspace);
 
     // Fill in header
     // Size of decompressed file
@@ -245,3 +271,11 @@ bool rocket::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
     Dst << outbuff.rdbuf();
     return true;
 }
+
+bool rocket::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, effort, 1, matchfinder);
+}
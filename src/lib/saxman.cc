@@ -20,6 +20,7 @@
 #include <mdcomp/bitstream.hh>
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/lzss.hh>
+#include <mdcomp/match_copy.hh>
 #include <mdcomp/saxman.hh>
 
 #include <cstdint>
@@ -28,20 +29,17 @@
 #include <limits>
 #include <ostream>
 #include <sstream>
+#include <vector>
 
 using std::array;
-using std::fill_n;
 using std::ios;
 using std::iostream;
 using std::istream;
 using std::numeric_limits;
 using std::ostream;
-using std::ostreambuf_iterator;
 using std::streamsize;
 using std::stringstream;
-
-template <>
-size_t moduled_saxman::PadMaskBits = 1U;
+using std::vector;
 
 class saxman_internal {
     // NOTE: This has to be changed for other LZSS-based compression schemes.
@@ -73,6 +71,9 @@ class saxman_internal {
         constexpr static bool const DescriptorLittleEndianBits = true;
         // How many characters to skip looking for matchs for at the start.
         constexpr static size_t const FirstMatchPosition = 0;
+        // How the sliding windows look for dictionary matches.
+        constexpr static MatchFinder const MatchFinderType
+                = MatchFinder::hash_chain;
         // Size of the search buffer.
         constexpr static size_t const SearchBufSize = 4096;
         // Size of the look-ahead buffer.
@@ -149,22 +150,24 @@ class saxman_internal {
     };
 
 public:
-    static void decode(istream& in, iostream& Dst, size_t const Size) {
+    static size_t decode(
+            uint8_t const* Data, size_t const FullSize, vector<uint8_t>& Dst,
+            size_t const Size) {
         using SaxIStream = LZSSIStream<SaxmanAdaptor>;
 
-        SaxIStream src(in);
+        SaxIStream src(Data, FullSize);
 
         // Loop while the file is good and we haven't gone over the declared
         // length.
-        while (in.good() && size_t(in.tellg()) < Size) {
+        while (src.good() && src.tell() < Size) {
             if (src.descbit() != 0U) {
                 // Symbolwise match.
-                if (in.peek() == EOF) {
+                if (src.at_end()) {
                     break;
                 }
-                Write1(Dst, src.getbyte());
+                Dst.push_back(src.getbyte());
             } else {
-                if (in.peek() == EOF) {
+                if (src.at_end()) {
                     break;
                 }
                 // Dictionary match.
@@ -182,35 +185,35 @@ class saxman_internal {
                 // 0x1000-byte block, with part of it being remapped to the end
                 // of the previous 0x1000-byte block. We just rebase it around
                 // basedest.
-                size_t const basedest = Dst.tellp();
+                size_t const basedest = Dst.size();
                 offset = ((offset - basedest) % SaxmanAdaptor::SearchBufSize)
                          + basedest - SaxmanAdaptor::SearchBufSize;
 
                 if (offset < basedest) {
                     // If the offset is before the current output position, we
                     // copy bytes from the given location.
-                    for (size_t csrc = offset; csrc < offset + length; csrc++) {
-                        size_t const Pointer = Dst.tellp();
-                        Dst.seekg(csrc);
-                        uint8_t const Byte = Read1(Dst);
-                        Dst.seekp(Pointer);
-                        Write1(Dst, Byte);
-                    }
+                    copy_match(Dst, basedest - offset, length);
                 } else {
                     // Otherwise, it is a zero fill.
-                    fill_n(ostreambuf_iterator<char>(Dst), length, 0);
+                    Dst.insert(Dst.end(), length, 0);
                 }
             }
         }
+        return src.tell();
     }
 
-    static void encode(ostream& Dst, uint8_t const*& Data, size_t const Size) {
+    static void encode(
+            ostream& Dst, uint8_t const*& Data, size_t const Size,
+            LZSSEffort const effort, size_t const numthreads,
+            MatchFinder const matchfinder, LZSSWorkspace& workspace) {
         using EdgeType   = typename SaxmanAdaptor::EdgeType;
         using SaxOStream = LZSSOStream<SaxmanAdaptor>;
 
         // Compute optimal Saxman parsing of input file.
-        auto       list = find_optimal_lzss_parse(Data, Size, SaxmanAdaptor{});
-        SaxOStream out(Dst);
+        auto const& list = find_optimal_lzss_parse(
+                Data, Size, SaxmanAdaptor{}, workspace, effort, numthreads,
+                matchfinder);
+        SaxOStream out(Dst, workspace);
 
         // Go through each edge in the optimal path.
         for (auto const& edge : list) {
@@ -248,21 +251,38 @@ bool saxman::decode(istream& Src, iostream& Dst, size_t Size) {
         Size = LittleEndian::Read2(Src);
     }
 
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    saxman_internal::decode(in, Dst, Size);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed
+            = saxman_internal::decode(in.data(), in.size(), out, Size);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
+size_t saxman::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    if (Size < 2) {
+        return Size;
+    }
+    uint8_t const* header         = data;
+    size_t const   CompressedSize = LittleEndian::Read2(header);
+    return saxman_internal::decode(data + 2, Size - 2, Dst, CompressedSize)
+           + 2;
+}
+
 bool saxman::encode(
         ostream& Dst, uint8_t const* data, size_t const Size,
-        bool const WithSize) {
+        bool const WithSize, LZSSEffort const effort,
+        size_t const numthreads, MatchFinder const matchfinder,
+        LZSSWorkspace& workspace) {
     stringstream outbuff(ios::in | ios::out | ios::binary);
     size_t       Start = outbuff.tellg();
-    saxman_internal::encode(outbuff, data, Size);
+    saxman_internal::encode(
+            outbuff, data, Size, effort, numthreads, matchfinder, workspace);
     if (WithSize) {
         outbuff.seekg(Start);
         outbuff.ignore(numeric_limits<streamsize>::max());
@@ -273,3 +293,11 @@ bool saxman::encode(
     Dst << outbuff.rdbuf();
     return true;
 }
+
+bool saxman::encode_module(
+        ostream& Dst, uint8_t const* data, size_t const Size,
+        size_t const PadMaskBits, LZSSEffort const effort,
+        MatchFinder const matchfinder) {
+    ignore_unused_variable_warning(PadMaskBits);
+    return encode(Dst, data, Size, true, effort, 1, matchfinder);
+}
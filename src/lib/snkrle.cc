@@ -20,11 +20,13 @@
 #include <mdcomp/ignore_unused_variable_warning.hh>
 #include <mdcomp/snkrle.hh>
 
+#include <algorithm>
 #include <istream>
 #include <limits>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <vector>
 
 using std::ios;
 using std::istream;
@@ -32,40 +34,49 @@ using std::numeric_limits;
 using std::ostream;
 using std::streamsize;
 using std::stringstream;
-
-template <>
-size_t moduled_snkrle::PadMaskBits = 1U;
+using std::vector;
 
 class snkrle_internal {
 public:
-    static void decode(istream& Src, ostream& Dst) {
-        size_t Size = BigEndian::Read2(Src);
+    static size_t decode(
+            uint8_t const* Data, size_t const InputSize, vector<uint8_t>& Dst) {
+        if (InputSize < 2) {
+            return InputSize;
+        }
+        uint8_t const* header = Data;
+        size_t         Size   = BigEndian::Read2(header);
+        size_t         pos    = 2;
+        // Reading past the end stops the decoding below.
+        auto getbyte = [&]() -> uint8_t {
+            uint8_t const value = pos < InputSize ? Data[pos] : 0U;
+            pos++;
+            return value;
+        };
         if (Size == 0) {
-            return;
+            return pos;
         }
-        uint8_t cc = Read1(Src);
-        Write1(Dst, cc);
+        uint8_t cc = getbyte();
+        Dst.push_back(cc);
         Size--;
-        while (Size > 0) {
-            uint8_t nc = Read1(Src);
-            Write1(Dst, nc);
+        while (Size > 0 && pos <= InputSize) {
+            uint8_t const nc = getbyte();
+            Dst.push_back(nc);
             Size--;
             if (cc == nc) {
                 // RLE marker. Get repeat count.
-                size_t Count = Read1(Src);
-                for (size_t ii = 0; ii < Count; ii++) {
-                    Write1(Dst, nc);
-                }
-                Size -= Count;
+                size_t const Count = getbyte();
+                Dst.insert(Dst.end(), Count, nc);
+                Size -= std::min(Count, Size);
                 if (Count == 255 && Size > 0) {
-                    cc = Read1(Src);
-                    Write1(Dst, nc);
+                    cc = getbyte();
+                    Dst.push_back(nc);
                     Size--;
                 }
             } else {
                 cc = nc;
             }
         }
+        return std::min(pos, InputSize);
     }
 
     static void encode(istream& Src, ostream& Dst) {
@@ -98,15 +109,22 @@ class snkrle_internal {
 };
 
 bool snkrle::decode(istream& Src, ostream& Dst) {
-    size_t const Location = Src.tellg();
-    stringstream in(ios::in | ios::out | ios::binary);
+    size_t const    Location = Src.tellg();
+    vector<uint8_t> in;
     extract(Src, in);
 
-    snkrle_internal::decode(in, Dst);
-    Src.seekg(Location + in.tellg());
+    vector<uint8_t> out;
+    size_t const    Consumed = decode(in.data(), in.size(), out);
+    Dst.write(reinterpret_cast<char const*>(out.data()), out.size());
+    Src.seekg(Location + Consumed);
     return true;
 }
 
+size_t snkrle::decode(
+        uint8_t const* data, size_t const Size, vector<uint8_t>& Dst) {
+    return snkrle_internal::decode(data, Size, Dst);
+}
+
 bool snkrle::encode(ostream& Dst, uint8_t const* data, size_t const Size) {
     stringstream Src(ios::in | ios::out | ios::binary);
     Src.write(reinterpret_cast<char const*>(data), Size);
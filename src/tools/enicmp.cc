@@ -33,34 +33,55 @@ using std::stringstream;
 
 static void usage(char* prog) {
     cerr << "Usage: " << prog
-         << " [-x|--extract=[{pointer}]] {input_filename} {output_filename}"
+         << " [-o|--optimal] [-e|--extended] [-x|--extract=[{pointer}]] "
+            "{input_filename} {output_filename}"
          << endl;
     cerr << endl;
-    cerr << "\t-x,--extract\tExtract from {pointer} address in file." << endl
+    cerr << "\t-x,--extract\tExtract from {pointer} address in file." << endl;
+    cerr << "\t-o,--optimal\tSplit the data into packets optimally, for a "
+            "smaller file."
+         << endl;
+    cerr << "\t-e,--extended\tTry more choices of header values, for a "
+            "smaller file."
+         << endl
          << endl;
 }
 
 int main(int argc, char* argv[]) {
-    static constexpr const std::array<option, 2> long_options{
+    static constexpr const std::array<option, 4> long_options{
             option{"extract", optional_argument, nullptr, 'x'},
+            option{"optimal", no_argument, nullptr, 'o'},
+            option{"extended", no_argument, nullptr, 'e'},
             option{nullptr, 0, nullptr, 0}};
 
-    bool   extract = false;
-    size_t pointer = 0;
+    bool         extract = false;
+    size_t       pointer = 0;
+    EnigmaParse  parse   = EnigmaParse::greedy;
+    EnigmaSearch search  = EnigmaSearch::standard;
 
     while (true) {
         int option_index = 0;
         int option_char  = getopt_long(
-                 argc, argv, "x::", long_options.data(), &option_index);
+                 argc, argv, "x::oe", long_options.data(), &option_index);
         if (option_char == -1) {
             break;
         }
 
-        if (option_char == 'x') {
+        switch (option_char) {
+        case 'x':
             extract = true;
             if (optarg != nullptr) {
                 pointer = strtoul(optarg, nullptr, 0);
             }
+            break;
+        case 'o':
+            parse = EnigmaParse::optimal;
+            break;
+        case 'e':
+            search = EnigmaSearch::extended;
+            break;
+        default:
+            break;
         }
     }
 
@@ -89,7 +110,7 @@ int main(int argc, char* argv[]) {
         fin.seekg(pointer);
         enigma::decode(fin, fout);
     } else {
-        enigma::encode(fin, fout);
+        enigma::encode(fin, fout, parse, search);
     }
 
     return 0;
@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include <mdcomp/kosplus.hh>
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <fstream>
@@ -55,13 +56,33 @@ static void usage(char* prog) {
             "output file)."
          << endl;
     cerr << "\t-m,--moduled\tUse compression in modules of 4096 bytes." << endl;
+    cerr << "\t-e,--effort \tCompression effort, from 0 (fastest) to 3 "
+            "(smallest, default):"
+         << endl
+         << "\t            \tgreedy, lazy, bounded optimal or optimal parsing."
+         << endl;
+    cerr << "\t-j,--threads\tHow many threads to compress with (default: one "
+            "per processor)."
+         << endl;
+    cerr << "\t-f,--finder \tHow to find matches: 0 (brute force), 1 (hash "
+            "chains, default)"
+         << endl
+         << "\t            \tor 2 (suffix array). With effort 3, all give the "
+            "same file; the suffix"
+         << endl
+         << "\t            \tarray is faster on large files with few distinct "
+            "values, slower on others."
+         << endl;
 }
 
 int main(int argc, char* argv[]) {
-    static constexpr const std::array<option, 4> long_options{
+    static constexpr const std::array<option, 7> long_options{
             option{"extract", optional_argument, nullptr, 'x'},
             option{"moduled", no_argument, nullptr, 'm'},
             option{"crunch", no_argument, nullptr, 'c'},
+            option{"effort", required_argument, nullptr, 'e'},
+            option{"threads", required_argument, nullptr, 'j'},
+            option{"finder", required_argument, nullptr, 'f'},
             option{nullptr, 0, nullptr, 0}};
 
     bool   extract = false;
@@ -69,10 +90,14 @@ int main(int argc, char* argv[]) {
     bool   crunch  = false;
     size_t pointer = 0;
 
+    LZSSEffort  effort      = LZSSEffort::optimal;
+    size_t      numthreads  = hardware_thread_count();
+    MatchFinder matchfinder = MatchFinder::hash_chain;
+
     while (true) {
         int option_index = 0;
         int option_char  = getopt_long(
-                 argc, argv, "x::mc", long_options.data(), &option_index);
+                 argc, argv, "x::mce:j:f:", long_options.data(), &option_index);
         if (option_char == -1) {
             break;
         }
@@ -90,6 +115,17 @@ int main(int argc, char* argv[]) {
         case 'm':
             moduled = true;
             break;
+        case 'e':
+            effort = static_cast<LZSSEffort>(
+                    std::min(strtoul(optarg, nullptr, 0), 3UL));
+            break;
+        case 'j':
+            numthreads = std::max(strtoul(optarg, nullptr, 0), 1UL);
+            break;
+        case 'f':
+            matchfinder = static_cast<MatchFinder>(
+                    std::min(strtoul(optarg, nullptr, 0), 2UL));
+            break;
         default:
             break;
         }
@@ -137,9 +173,11 @@ int main(int argc, char* argv[]) {
             return 3;
         }
         if (moduled) {
-            kosplus::moduled_encode(buffer, fout);
+            kosplus::moduled_encode(
+                    buffer, fout, kosplus::ModulePadding, numthreads, effort,
+                    matchfinder);
         } else {
-            kosplus::encode(buffer, fout);
+            kosplus::encode(buffer, fout, effort, numthreads, matchfinder);
         }
     } else {
         fstream fout(outfile, ios::in | ios::out | ios::binary | ios::trunc);
@@ -159,9 +197,11 @@ int main(int argc, char* argv[]) {
             }
         } else {
             if (moduled) {
-                kosplus::moduled_encode(fin, fout);
+                kosplus::moduled_encode(
+                        fin, fout, kosplus::ModulePadding, numthreads, effort,
+                        matchfinder);
             } else {
-                kosplus::encode(fin, fout);
+                kosplus::encode(fin, fout, effort, numthreads, matchfinder);
             }
         }
     }
@@ -42,8 +42,8 @@ using std::uppercase;
 
 static void usage(char* prog) {
     cerr << "Usage: " << prog
-         << " [-i] [-c|--crunch|-x|--extract=[{pointer}]] {input_filename} "
-            "{output_filename}"
+         << " [-i] [-e|--extended] [-c|--crunch|-x|--extract=[{pointer}]] "
+            "{input_filename} {output_filename}"
          << endl;
     cerr << endl;
     cerr << "\t-i          \tWhen extracting, print out the position where the "
@@ -56,14 +56,24 @@ static void usage(char* prog) {
          << "\t            \tIf --crunch is in effect, a missing "
             "output_filename means recompress"
          << endl
-         << "\t            \tto input_filename." << endl
+         << "\t            \tto input_filename." << endl;
+    cerr << "\t-e,--extended\tTry more ways of building the code table, for a "
+            "smaller file."
+         << endl
+         << "\t             \tThis is a plain search, with twice as many "
+            "attempts; it takes up to"
+         << endl
+         << "\t             \ttwice as long, unless there are enough "
+            "processors to run them all."
+         << endl
          << endl;
 }
 
 int main(int argc, char* argv[]) {
-    static constexpr const std::array<option, 3> long_options{
+    static constexpr const std::array<option, 4> long_options{
             option{"extract", optional_argument, nullptr, 'x'},
             option{"crunch", no_argument, nullptr, 'c'},
+            option{"extended", no_argument, nullptr, 'e'},
             option{nullptr, 0, nullptr, 0}};
 
     bool   extract  = false;
@@ -71,10 +81,12 @@ int main(int argc, char* argv[]) {
     bool   crunch   = false;
     size_t pointer  = 0;
 
+    NemesisSearch search = NemesisSearch::standard;
+
     while (true) {
         int option_index = 0;
         int option_char  = getopt_long(
-                 argc, argv, "x::ic", long_options.data(), &option_index);
+                 argc, argv, "x::ice", long_options.data(), &option_index);
         if (option_char == -1) {
             break;
         }
@@ -92,6 +104,9 @@ int main(int argc, char* argv[]) {
         case 'c':
             crunch = true;
             break;
+        case 'e':
+            search = NemesisSearch::extended;
+            break;
         default:
             break;
         }
@@ -138,7 +153,7 @@ int main(int argc, char* argv[]) {
                  << endl;
             return 3;
         }
-        nemesis::encode(buffer, fout);
+        nemesis::encode(buffer, fout, search);
     } else {
         ofstream fout(outfile, ios::out | ios::binary);
         if (!fout.good()) {
@@ -157,7 +172,7 @@ int main(int argc, char* argv[]) {
                      << right << fin.tellg() << endl;
             }
         } else {
-            nemesis::encode(fin, fout);
+            nemesis::encode(fin, fout, search);
         }
     }
     return 0;
@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include <mdcomp/rocket.hh>
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
 #include <fstream>
@@ -47,22 +48,46 @@ static void usage(char* prog) {
          << endl
          << "\t            \tto input_filename." << endl
          << endl;
+    cerr << "\t-e,--effort \tCompression effort, from 0 (fastest) to 3 "
+            "(smallest, default):"
+         << endl
+         << "\t            \tgreedy, lazy, bounded optimal or optimal parsing."
+         << endl;
+    cerr << "\t-j,--threads\tHow many threads to compress with (default: one "
+            "per processor)."
+         << endl;
+    cerr << "\t-f,--finder \tHow to find matches: 0 (brute force), 1 (hash "
+            "chains, default)"
+         << endl
+         << "\t            \tor 2 (suffix array). With effort 3, all give the "
+            "same file; the suffix"
+         << endl
+         << "\t            \tarray is faster on large files with few distinct "
+            "values, slower on others."
+         << endl;
 }
 
 int main(int argc, char* argv[]) {
-    static constexpr const std::array<option, 3> long_options{
+    static constexpr const std::array<option, 6> long_options{
             option{"extract", optional_argument, nullptr, 'x'},
             option{"crunch", no_argument, nullptr, 'c'},
+            option{"effort", required_argument, nullptr, 'e'},
+            option{"threads", required_argument, nullptr, 'j'},
+            option{"finder", required_argument, nullptr, 'f'},
             option{nullptr, 0, nullptr, 0}};
 
     bool   extract = false;
     bool   crunch  = false;
     size_t pointer = 0;
 
+    LZSSEffort  effort      = LZSSEffort::optimal;
+    size_t      numthreads  = hardware_thread_count();
+    MatchFinder matchfinder = MatchFinder::hash_chain;
+
     while (true) {
         int option_index = 0;
         int option_char  = getopt_long(
-                 argc, argv, "x::c", long_options.data(), &option_index);
+                 argc, argv, "x::ce:j:f:", long_options.data(), &option_index);
         if (option_char == -1) {
             break;
         }
@@ -77,6 +102,17 @@ int main(int argc, char* argv[]) {
         case 'c':
             crunch = true;
             break;
+        case 'e':
+            effort = static_cast<LZSSEffort>(
+                    std::min(strtoul(optarg, nullptr, 0), 3UL));
+            break;
+        case 'j':
+            numthreads = std::max(strtoul(optarg, nullptr, 0), 1UL);
+            break;
+        case 'f':
+            matchfinder = static_cast<MatchFinder>(
+                    std::min(strtoul(optarg, nullptr, 0), 2UL));
+            break;
         default:
             break;
         }
@@ -119,7 +155,7 @@ int main(int argc, char* argv[]) {
                  << endl;
             return 3;
         }
-        rocket::encode(buffer, fout);
+        rocket::encode(buffer, fout, effort, numthreads, matchfinder);
     } else {
         fstream fout(outfile, ios::in | ios::out | ios::binary | ios::trunc);
         if (!fout.good()) {
@@ -133,7 +169,7 @@ int main(int argc, char* argv[]) {
             fin.seekg(pointer);
             rocket::decode(fin, fout);
         } else {
-            rocket::encode(fin, fout);
+            rocket::encode(fin, fout, effort, numthreads, matchfinder);
         }
     }
 
@@ -18,6 +18,7 @@
 #include <getopt.h>
 #include <mdcomp/saxman.hh>
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cstdlib>
@@ -55,12 +56,32 @@ static void usage(char* prog) {
             "Only affects compression."
          << endl
          << endl;
+    cerr << "\t-e,--effort \tCompression effort, from 0 (fastest) to 3 "
+            "(smallest, default):"
+         << endl
+         << "\t            \tgreedy, lazy, bounded optimal or optimal parsing."
+         << endl;
+    cerr << "\t-j,--threads\tHow many threads to compress with (default: one "
+            "per processor)."
+         << endl;
+    cerr << "\t-f,--finder \tHow to find matches: 0 (brute force), 1 (hash "
+            "chains, default)"
+         << endl
+         << "\t            \tor 2 (suffix array). With effort 3, all give the "
+            "same file; the suffix"
+         << endl
+         << "\t            \tarray is faster on large files with few distinct "
+            "values, slower on others."
+         << endl;
 }
 
 int main(int argc, char* argv[]) {
-    static constexpr const std::array<option, 3> long_options{
+    static constexpr const std::array<option, 6> long_options{
             option{"extract", optional_argument, nullptr, 'x'},
             option{"crunch", no_argument, nullptr, 'c'},
+            option{"effort", required_argument, nullptr, 'e'},
+            option{"threads", required_argument, nullptr, 'j'},
+            option{"finder", required_argument, nullptr, 'f'},
             option{nullptr, 0, nullptr, 0}};
 
     bool   extract  = false;
@@ -69,10 +90,15 @@ int main(int argc, char* argv[]) {
     size_t pointer  = 0;
     size_t BSize    = 0;
 
+    LZSSEffort  effort      = LZSSEffort::optimal;
+    size_t      numthreads  = hardware_thread_count();
+    MatchFinder matchfinder = MatchFinder::hash_chain;
+
     while (true) {
         int option_index = 0;
         int option_char  = getopt_long(
-                 argc, argv, "x::cs:S", long_options.data(), &option_index);
+                 argc, argv, "x::cs:Se:j:f:", long_options.data(),
+                 &option_index);
         if (option_char == -1) {
             break;
         }
@@ -100,6 +126,17 @@ int main(int argc, char* argv[]) {
         case 'S':
             WithSize = false;
             break;
+        case 'e':
+            effort = static_cast<LZSSEffort>(
+                    std::min(strtoul(optarg, nullptr, 0), 3UL));
+            break;
+        case 'j':
+            numthreads = std::max(strtoul(optarg, nullptr, 0), 1UL);
+            break;
+        case 'f':
+            matchfinder = static_cast<MatchFinder>(
+                    std::min(strtoul(optarg, nullptr, 0), 2UL));
+            break;
         default:
             break;
         }
@@ -142,7 +179,7 @@ int main(int argc, char* argv[]) {
                  << endl;
             return 3;
         }
-        saxman::encode(buffer, fout, WithSize);
+        saxman::encode(buffer, fout, WithSize, effort, numthreads, matchfinder);
     } else {
         fstream fout(outfile, ios::in | ios::out | ios::binary | ios::trunc);
         if (!fout.good()) {
@@ -156,7 +193,8 @@ int main(int argc, char* argv[]) {
             fin.seekg(pointer);
             saxman::decode(fin, fout, BSize);
         } else {
-            saxman::encode(fin, fout, WithSize);
+            saxman::encode(
+                    fin, fout, WithSize, effort, numthreads, matchfinder);
         }
     }
 